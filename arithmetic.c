@@ -5,58 +5,57 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
-#define ARITHMETIC_FOLD(operator, args, acc, env) \
+#define ARITHMETIC_FOLD(operator, argc, argv, acc, env) \
 	do { \
-		navi_obj ____MAF_CONS; \
-		navi_type_check(navi_car(args), NAVI_FIXNUM, env); \
-		acc = navi_car(args); \
-		navi_list_for_each(____MAF_CONS, navi_cdr(args)) { \
-			navi_type_check(navi_car(____MAF_CONS), NAVI_FIXNUM, env); \
-			acc.n = operator(acc.n, navi_car(____MAF_CONS).n); \
+		navi_type_check(argv[0], NAVI_FIXNUM, env); \
+		acc = argv[0]; \
+		for (unsigned ____MAF_I = 1; ____MAF_I < argc; ____MAF_I++) { \
+			navi_type_check(argv[____MAF_I], NAVI_FIXNUM, env); \
+			acc.n = operator(acc.n, argv[____MAF_I].n); \
 		} \
 	} while (0)
 
 DEFUN(add, "+", 0, NAVI_PROC_VARIADIC)
 {
 	navi_obj acc = navi_make_fixnum(0);
-	if (navi_is_nil(scm_args))
+	if (scm_nr_args == 0)
 		return navi_make_fixnum(0);
-	if (navi_is_nil(navi_cdr(scm_args)))
+	if (scm_nr_args == 1)
 		return scm_arg1;
-	ARITHMETIC_FOLD(navi_fixnum_plus, scm_args, acc, scm_env);
+	ARITHMETIC_FOLD(navi_fixnum_plus, scm_nr_args, scm_argv, acc, scm_env);
 	return acc;
 }
 
 DEFUN(sub, "-", 1, NAVI_PROC_VARIADIC, NAVI_FIXNUM)
 {
 	navi_obj acc;
-	if (navi_is_nil(navi_cdr(scm_args))) {
+	if (scm_nr_args == 1) {
 		acc.n = navi_fixnum_minus(navi_make_fixnum(0).n, scm_arg1.n);
 		return acc;
 	}
-	ARITHMETIC_FOLD(navi_fixnum_minus, scm_args, acc, scm_env);
+	ARITHMETIC_FOLD(navi_fixnum_minus, scm_nr_args, scm_argv, acc, scm_env);
 	return acc;
 }
 
 DEFUN(mul, "*", 0, NAVI_PROC_VARIADIC)
 {
 	navi_obj acc;
-	if (navi_is_nil(scm_args))
+	if (scm_nr_args == 0)
 		return navi_make_fixnum(1);
-	if (navi_is_nil(navi_cdr(scm_args)))
+	if (scm_nr_args == 1)
 		return scm_arg1;
-	ARITHMETIC_FOLD(navi_fixnum_times, scm_args, acc, scm_env);
+	ARITHMETIC_FOLD(navi_fixnum_times, scm_nr_args, scm_argv, acc, scm_env);
 	return acc;
 }
 
 DEFUN(div, "/", 1, NAVI_PROC_VARIADIC, NAVI_FIXNUM)
 {
 	navi_obj acc;
-	if (navi_is_nil(navi_cdr(scm_args))) {
+	if (scm_nr_args == 1) {
 		acc.n = navi_fixnum_divide(navi_make_fixnum(1).n, scm_arg1.n);
 		return acc;
 	}
-	ARITHMETIC_FOLD(navi_fixnum_divide, scm_args, acc, scm_env);
+	ARITHMETIC_FOLD(navi_fixnum_divide, scm_nr_args, scm_argv, acc, scm_env);
 	return acc;
 }
 
@@ -70,15 +69,11 @@ DEFUN(remainder, "remainder", 2, 0, NAVI_FIXNUM, NAVI_FIXNUM)
 	return navi_make_fixnum(navi_fixnum(scm_arg1) % navi_fixnum(scm_arg2));
 }
 
-static bool fold_pairs(navi_obj list, bool (*compare)(navi_obj,navi_obj,navi_env),
-		navi_env env)
+static bool fold_pairs(unsigned argc, const navi_obj *argv,
+		bool (*compare)(navi_obj,navi_obj,navi_env), navi_env env)
 {
-	navi_obj cons;
-
-	navi_list_for_each(cons, list) {
-		if (navi_type(navi_cdr(cons)) == NAVI_NIL)
-			return true;
-		if (!compare(navi_car(cons), navi_cadr(cons), env))
+	for (unsigned i = 1; i < argc; i++) {
+		if (!compare(argv[i-1], argv[i], env))
 			return false;
 	}
 	return true;
@@ -94,7 +89,7 @@ static bool fold_pairs(navi_obj list, bool (*compare)(navi_obj,navi_obj,navi_env
 	} \
 	DEFUN(cname, scmname, 1, NAVI_PROC_VARIADIC, NAVI_FIXNUM) \
 	{ \
-		return navi_make_bool(fold_pairs(scm_args, _ ## cname, scm_env)); \
+		return navi_make_bool(fold_pairs(scm_nr_args, scm_argv, _ ## cname, scm_env)); \
 	}
 
 NUMERIC_COMPARISON(lt,    "<",  <)
@@ -120,7 +115,7 @@ DEFUN(number_to_string, "number->string", 1, NAVI_PROC_VARIADIC, NAVI_FIXNUM)
 	char buf[64];
 	long radix = 10;
 
-	if (navi_type(navi_cdr(scm_args)) != NAVI_NIL) {
+	if (scm_nr_args > 1) {
 		navi_type_check(scm_arg2, NAVI_FIXNUM, scm_env);
 		radix = navi_fixnum(scm_arg2);
 	}
@@ -160,7 +155,7 @@ DEFUN(string_to_number, "string->number", 1, NAVI_PROC_VARIADIC, NAVI_STRING)
 	long n, radix;
 
 	string = (char*) navi_string(scm_arg1)->data;
-	radix = navi_is_nil(navi_cdr(scm_args)) ? 10 : navi_fixnum_cast(scm_arg2, scm_env);
+	radix = scm_nr_args == 1 ? 10 : navi_fixnum_cast(scm_arg2, scm_env);
 
 	if ((n = explicit_radix(string)) != 0) {
 		string += 2;
@@ -185,13 +180,11 @@ DEFUN(booleanp, "boolean?", 1, 0, NAVI_ANY)
 
 DEFUN(boolean_eq, "boolean=?", 1, NAVI_PROC_VARIADIC, NAVI_BOOL)
 {
-	navi_obj cons;
-	navi_obj bval;
+	navi_obj bval = scm_arg1;
 
-	bval = scm_arg1;
-	navi_list_for_each(cons, navi_cdr(scm_args)) {
-		navi_type_check(navi_car(cons), NAVI_BOOL, scm_env);
-		if (navi_car(cons).n != bval.n)
+	for (unsigned i = 1; i < scm_nr_args; i++) {
+		navi_type_check(scm_argv[i], NAVI_BOOL, scm_env);
+		if (scm_argv[i].n != bval.n)
 			return navi_make_bool(false);
 	}
 	return navi_make_bool(true);
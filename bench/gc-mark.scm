@@ -0,0 +1,54 @@
+;; Copyright 2014-2015 Drew Thoreson
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+;; Marking benchmark: times full collections of a heap holding a long list,
+;; a deep binary tree and a deeply nested chain of cars.
+;;
+;;   navii -L . bench/gc-mark.scm
+
+(import (scheme base) (scheme write) (scheme time))
+
+(define list-length 10000000)
+(define tree-depth 20)
+(define nest-depth 1000000)
+(define rounds 5)
+
+(define (make-tree depth)
+  (if (= depth 0)
+    '()
+    (cons (make-tree (- depth 1)) (make-tree (- depth 1)))))
+
+(define (make-nest depth nest)
+  (if (= depth 0)
+    nest
+    (make-nest (- depth 1) (cons nest '()))))
+
+(define (time-collections name)
+  (##gc-collect)
+  (define (collect i)
+    (if (< i rounds)
+      (begin (##gc-collect)
+             (collect (+ i 1)))))
+  (let ((start (current-jiffy)))
+    (collect 0)
+    (display name)
+    (display ": ")
+    (display (quotient (* 1000 (- (current-jiffy) start))
+                       (* rounds (jiffies-per-second))))
+    (display " ms per collection")
+    (newline)))
+
+(define long-list (make-list list-length 0))
+(time-collections "list")
+(set! long-list #f)
+
+(define tree (make-tree tree-depth))
+(time-collections "tree")
+(set! tree #f)
+
+(define nest (make-nest nest-depth '()))
+(time-collections "nest")
+(set! nest #f)
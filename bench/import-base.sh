@@ -0,0 +1,41 @@
+#!/bin/sh
+# Copyright 2014-2015 Drew Thoreson
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+# Import benchmark: times processes which do nothing but import (scheme base),
+# parsing the library from source, reading it from the library cache and
+# restoring it from a heap image.
+#
+#   bench/import-base.sh [NAVII [RUNS]]
+
+navii=${1:-./navii}
+runs=${2:-200}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+echo '(import (scheme base))' > "$dir/import.scm"
+
+run() {
+	start=$(date +%s%N)
+	i=0
+	while [ $i -lt $runs ]; do
+		"$@" "$dir/import.scm" || exit 1
+		i=$((i + 1))
+	done
+	end=$(date +%s%N)
+	echo "$(( (end - start) / runs / 1000 )) us per process"
+}
+
+printf 'source: '
+NAVI_CACHE_DIR= run "$navii" -L .
+
+printf 'cache:  '
+NAVI_CACHE_DIR="$dir/cache" "$navii" -L . "$dir/import.scm"
+NAVI_CACHE_DIR="$dir/cache" run "$navii" -L .
+
+printf 'image:  '
+NAVI_CACHE_DIR= "$navii" -L . --save-image "$dir/image"
+NAVI_CACHE_DIR= run "$navii" -I "$dir/image"
@@ -0,0 +1,66 @@
+;; Copyright 2014-2015 Drew Thoreson
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+;; Slab arena benchmark: times pair allocation and full collections with the
+;; pair and thunk caches carving their slabs out of arenas of the given size.
+;; Compare 4 KiB arenas (one allocation per slab) with 2 MiB (huge pages):
+;;
+;;   navii -L . bench/slab-arena.scm 4096
+;;   navii -L . bench/slab-arena.scm 2097152
+
+(import (scheme base) (scheme write) (scheme time) (scheme process-context))
+
+(define arena
+  (if (null? (cdr (command-line)))
+    2097152
+    (string->number (cadr (command-line)))))
+(##gc-set-slab-arena! arena)
+
+(define list-length 5000000)
+(define rounds 5)
+
+(define (time-ms thunk)
+  (let ((start (current-jiffy)))
+    (thunk)
+    (quotient (* 1000 (- (current-jiffy) start))
+              (jiffies-per-second))))
+
+(define (report name ms unit)
+  (display name)
+  (display ": ")
+  (display ms)
+  (display unit)
+  (newline))
+
+(define (repeat n thunk)
+  (if (> n 0)
+    (begin (thunk)
+           (repeat (- n 1) thunk))))
+
+(display "arena: ")
+(display arena)
+(newline)
+
+;; short-lived pairs, reclaimed by minor collections
+(report "alloc (young)"
+        (quotient (time-ms (lambda ()
+                             (repeat rounds (lambda ()
+                                              (make-list list-length 0)))))
+                  rounds)
+        " ms per 5M pairs")
+
+;; long-lived pairs, promoted and kept
+(define long-list #f)
+(report "alloc (old)"
+        (time-ms (lambda () (set! long-list (make-list list-length 0))))
+        " ms per 5M pairs")
+
+(##gc-collect)
+(report "gc"
+        (quotient (time-ms (lambda () (repeat rounds ##gc-collect)))
+                  rounds)
+        " ms per collection")
+(set! long-list #f)
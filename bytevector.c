@@ -84,19 +84,18 @@ DEFUN(bytevector_u8_set, "bytevector-u8-set!", 3, 0,
 
 DEFUN(bytevector_append, "bytevector-append", 0, NAVI_PROC_VARIADIC)
 {
-	navi_obj cons, obj;
+	navi_obj obj;
 	struct navi_bytevec *vec;
 	size_t i = 0, size = 0;
 
-	navi_list_for_each(cons, scm_args) {
-		size += navi_bytevec_cast(navi_car(cons), scm_env)->size;
-	}
+	for (unsigned k = 0; k < scm_nr_args; k++)
+		size += navi_bytevec_cast(scm_argv[k], scm_env)->size;
 
 	obj = navi_make_bytevec(size);
 	vec = navi_bytevec(obj);
 
-	navi_list_for_each(cons, scm_args) {
-		struct navi_bytevec *other = navi_bytevec(navi_car(cons));
+	for (unsigned k = 0; k < scm_nr_args; k++) {
+		struct navi_bytevec *other = navi_bytevec(scm_argv[k]);
 		for (size_t j = 0; j < other->size; j++)
 			vec->data[i++] = other->data[j];
 	}
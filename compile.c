@@ -0,0 +1,1422 @@
+/* Copyright 2014-2015 Drew Thoreson
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Closure compiler: converts procedure bodies into trees of C closures.
+ *
+ * The tree-walker in eval.c dispatches on the type of every form it sees,
+ * checks that every call is a proper list and looks up the operator of every
+ * special form each time an expression is evaluated.  The compiler does that
+ * work once: a procedure body is analysed the first time the procedure is
+ * applied, and each form becomes a node carrying a function pointer and its
+ * pre-analysed operands.  The resulting tree is cached on the procedure (and
+ * shared by every closure created from the same lambda expression).
+ *
+ * Each procedure call and let form gets a frame: an array of slots holding the
+ * variables bound by the form (and by the internal definitions in its body).
+ * References to these variables are resolved at compile time to a (depth,
+ * index) pair, so that looking one up at run time is a walk up @depth frames
+ * and an array access.  Other variables are looked up by name.
+ *
+ * Special forms are resolved when the body is compiled, by looking up the
+ * operator in the procedure's environment.  Operators which are not bound to
+ * one of the special forms handled here (or which are shadowed by a local
+ * variable) are compiled as ordinary calls; forms that the compiler does not
+ * understand are left to the tree-walker.
+ *
+ * For the bytecode engine, the tree is then flattened into instructions for
+ * the VM in vm.c (see "Bytecode generation" below) and discarded.
+ */
+
+#include "vm.h"
+
+enum node_type {
+	NODE_CONSTANT,
+	NODE_REF,
+	NODE_LOCAL_REF,
+	NODE_LOCAL_SET,
+	NODE_IF,
+	NODE_SEQUENCE,
+	NODE_AND,
+	NODE_OR,
+	NODE_DEFINE,
+	NODE_SET,
+	NODE_LAMBDA,
+	NODE_LET,
+	NODE_SEQUENTIAL_LET,
+	NODE_COND,
+	NODE_CALL,
+	NODE_EVAL,
+};
+
+struct node;
+typedef navi_obj (*node_fn)(struct node *node, navi_env env);
+
+struct node {
+	node_fn fn;
+	enum node_type type;
+	bool tail;
+	navi_obj form;
+	union {
+		navi_obj constant;
+		struct {
+			navi_obj symbol;
+			/* the number of frames created by this code */
+			unsigned depth;
+			struct navi_ref_cache cache;
+		} ref;
+		struct {
+			unsigned depth;
+			unsigned index;
+			struct node *value;
+		} local;
+		struct {
+			struct node *test;
+			struct node *consequent;
+			struct node *alternative;
+		} branch;
+		struct {
+			unsigned nr;
+			struct node **nodes;
+		} seq;
+		struct {
+			navi_obj symbol;
+			struct node *value;
+		} assign;
+		struct {
+			navi_obj args;
+			navi_obj body;
+			navi_obj name;
+			bool anonymous;
+			struct navi_code *code;
+		} lambda;
+		struct {
+			unsigned nr;
+			unsigned nr_slots;
+			struct navi_code *code;
+			navi_obj *vars;
+			struct node **inits;
+			struct node *body;
+		} let;
+		struct {
+			unsigned nr;
+			struct node **tests;
+			struct node **bodies;
+		} cond;
+		struct {
+			struct node *op;
+			unsigned nr;
+			struct node **args;
+		} call;
+	};
+};
+
+/* Compile-time view of a frame: the variables it binds, in slot order. */
+struct cscope {
+	struct cscope *next;
+	unsigned nr;
+	unsigned size;
+	navi_obj *vars;
+};
+
+struct compiler {
+	struct navi_scope *env;
+	struct navi_code *code;
+	struct cscope *scope;
+};
+
+/*
+ * Pending tail call.  A call in tail position to a compound procedure stores
+ * its target here and returns the tail call marker; navi_code_apply then
+ * applies the target without growing the C stack.
+ */
+#define tail_call (_navi_vm->tail_call)
+
+static struct navi_object tail_call_marker = { .type = NAVI_TRAP };
+
+static inline navi_obj tail_call_obj(void)
+{
+	return (navi_obj) { .p = &tail_call_marker };
+}
+
+static inline bool is_tail_call(navi_obj obj)
+{
+	return obj.p == &tail_call_marker;
+}
+
+static inline navi_obj exec(struct node *node, navi_env env)
+{
+	return node->fn(node, env);
+}
+
+/* Execution {{{ */
+static navi_obj exec_constant(struct node *node, navi_env env)
+{
+	return node->constant;
+}
+
+static navi_obj exec_ref(struct node *node, navi_env env)
+{
+	navi_obj *cell = navi_env_cached_cell(env.lexical, node->ref.depth,
+			node->ref.symbol, &node->ref.cache);
+	if (unlikely(!cell || navi_is_void(*cell)))
+		navi_unbound_identifier_error(env, node->ref.symbol);
+	return *cell;
+}
+
+static navi_obj exec_if(struct node *node, navi_env env)
+{
+	if (navi_is_true(exec(node->branch.test, env)))
+		return exec(node->branch.consequent, env);
+	if (node->branch.alternative)
+		return exec(node->branch.alternative, env);
+	return navi_unspecified();
+}
+
+static navi_obj exec_sequence(struct node *node, navi_env env)
+{
+	unsigned i;
+	for (i = 0; i < node->seq.nr - 1; i++)
+		exec(node->seq.nodes[i], env);
+	return exec(node->seq.nodes[i], env);
+}
+
+static navi_obj exec_and(struct node *node, navi_env env)
+{
+	unsigned i;
+	if (node->seq.nr == 0)
+		return navi_make_bool(true);
+	for (i = 0; i < node->seq.nr - 1; i++) {
+		if (!navi_is_true(exec(node->seq.nodes[i], env)))
+			return navi_make_bool(false);
+	}
+	return exec(node->seq.nodes[i], env);
+}
+
+static navi_obj exec_or(struct node *node, navi_env env)
+{
+	unsigned i;
+	if (node->seq.nr == 0)
+		return navi_make_bool(false);
+	for (i = 0; i < node->seq.nr - 1; i++) {
+		if (navi_is_true(exec(node->seq.nodes[i], env)))
+			return navi_make_bool(true);
+	}
+	return exec(node->seq.nodes[i], env);
+}
+
+static navi_obj exec_local_ref(struct node *node, navi_env env)
+{
+	navi_obj val;
+	struct navi_scope *frame = env.lexical;
+
+	for (unsigned i = 0; i < node->local.depth; i++)
+		frame = frame->next;
+	val = frame->slots[node->local.index];
+	if (unlikely(navi_is_void(val)))
+		navi_unbound_identifier_error(env, node->form);
+	return val;
+}
+
+static navi_obj exec_local_set(struct node *node, navi_env env)
+{
+	struct navi_scope *frame = env.lexical;
+
+	for (unsigned i = 0; i < node->local.depth; i++)
+		frame = frame->next;
+	frame->slots[node->local.index] = exec(node->local.value, env);
+	return navi_unspecified();
+}
+
+static navi_obj exec_define(struct node *node, navi_env env)
+{
+	navi_scope_set(env.lexical, node->assign.symbol,
+			exec(node->assign.value, env));
+	return navi_unspecified();
+}
+
+static navi_obj exec_set(struct node *node, navi_env env)
+{
+	navi_obj *cell;
+
+	cell = navi_env_cell(env.lexical, node->assign.symbol);
+	if (unlikely(!cell))
+		navi_unbound_identifier_error(env, node->assign.symbol);
+
+	*cell = exec(node->assign.value, env);
+	return navi_unspecified();
+}
+
+static navi_obj exec_lambda(struct node *node, navi_env env)
+{
+	navi_obj proc = navi_make_procedure(node->lambda.args, node->lambda.body,
+			node->lambda.name, env);
+	navi_procedure(proc)->code = navi_code_ref(node->lambda.code);
+	return proc;
+}
+
+static navi_obj exec_let(struct node *node, navi_env env)
+{
+	navi_obj result;
+	navi_env new = navi_env_new_frame(env, node->let.code,
+			node->let.nr_slots, node->let.vars);
+
+	for (unsigned i = 0; i < node->let.nr; i++)
+		new.lexical->slots[i] = exec(node->let.inits[i], env);
+	result = exec(node->let.body, new);
+	navi_env_unref(new);
+	return result;
+}
+
+static navi_obj exec_sequential_let(struct node *node, navi_env env)
+{
+	navi_obj result;
+	navi_env new = navi_env_new_frame(env, node->let.code,
+			node->let.nr_slots, node->let.vars);
+
+	for (unsigned i = 0; i < node->let.nr; i++)
+		new.lexical->slots[i] = exec(node->let.inits[i], new);
+	result = exec(node->let.body, new);
+	navi_env_unref(new);
+	return result;
+}
+
+static navi_obj exec_cond(struct node *node, navi_env env)
+{
+	for (unsigned i = 0; i < node->cond.nr; i++) {
+		struct node *test = node->cond.tests[i];
+		if (!test || navi_is_true(exec(test, env)))
+			return exec(node->cond.bodies[i], env);
+	}
+	return navi_unspecified();
+}
+
+static navi_obj eval_args(struct node *node, navi_env env)
+{
+	struct navi_pair head, *ptr = &head;
+	size_t guard = navi_gc_roots();
+
+	for (unsigned i = 0; i < node->call.nr; i++) {
+		ptr->cdr = navi_make_pair(navi_make_void(), navi_make_nil());
+		if (ptr == &head)
+			navi_gc_guard(ptr->cdr);
+		else
+			navi_gc_write_barrier(navi_object(ptr), ptr->cdr);
+		ptr = navi_pair(ptr->cdr);
+		ptr->car = exec(node->call.args[i], env);
+		navi_gc_write_barrier(navi_object(ptr), ptr->car);
+	}
+	ptr->cdr = navi_make_nil();
+
+	navi_gc_unguard(guard);
+	return head.cdr;
+}
+
+static navi_obj exec_call(struct node *node, navi_env env)
+{
+	navi_obj args, result, op = exec(node->call.op, env);
+	size_t guard = navi_gc_guard(op);
+	struct navi_procedure *proc;
+
+	if (unlikely(!navi_is_procedure(op))) {
+		result = navi_dispatch_call(op, node->form, env);
+		goto out;
+	}
+
+	proc = navi_procedure(op);
+	if (proc->c_argv && node->call.nr <= NAVI_ARGV_MAX) {
+		navi_obj argv[NAVI_ARGV_MAX];
+		for (unsigned i = 0; i < node->call.nr; i++) {
+			argv[i] = exec(node->call.args[i], env);
+			navi_gc_guard(argv[i]);
+		}
+		result = navi_apply_argv(proc, node->call.nr, argv, env);
+		goto out;
+	}
+
+	args = eval_args(node, env);
+	if (node->tail && !navi_proc_is_builtin(proc)) {
+		if (unlikely(!navi_arity_satisfied(proc, node->call.nr)))
+			navi_arity_error(env, proc->name);
+		navi_gc_unguard(guard);
+		tail_call.proc = proc;
+		tail_call.args = args;
+		return tail_call_obj();
+	}
+	result = navi_apply(proc, args, env);
+out:
+	navi_gc_unguard(guard);
+	return node->tail ? result : navi_force_tail(result, env);
+}
+
+/* Forms the compiler doesn't handle are passed to the tree-walker. */
+static navi_obj exec_eval(struct node *node, navi_env env)
+{
+	if (node->tail)
+		return navi_make_bounce(node->form, env);
+	return navi_eval(node->form, env);
+}
+
+static navi_obj procedure_obj(struct navi_procedure *proc)
+{
+	return (navi_obj) { .p = navi_object(proc) };
+}
+
+/*
+ * Create the frame for a call to @proc: the formals come first, followed by
+ * the procedure's internal definitions.  The arity has already been checked.
+ */
+static navi_env make_frame(struct navi_procedure *proc, navi_obj args,
+		navi_env env)
+{
+	unsigned i;
+	navi_obj cons = args;
+	navi_env frame = navi_env_new_frame(env, proc->code,
+			proc->code->nr_slots, proc->code->names);
+
+	for (i = 0; i < proc->arity; i++) {
+		frame.lexical->slots[i] = navi_car(cons);
+		cons = navi_cdr(cons);
+	}
+	if (navi_proc_is_variadic(proc))
+		frame.lexical->slots[i] = cons;
+	return frame;
+}
+
+/*
+ * Apply a compound procedure using its compiled body, compiling the body
+ * first if necessary.  Tail calls made by the body are applied here, so
+ * that a chain of tail calls runs in constant C stack space.  The result is
+ * either a value or a bounce returned by the tree-walker.
+ */
+navi_obj navi_code_apply(struct navi_procedure *proc, navi_obj args,
+		navi_env env)
+{
+	for (;;) {
+		navi_obj result;
+		navi_env frame;
+		size_t guard;
+
+		if (unlikely(!proc->code || proc->code->engine != NAVI_ENGINE_CLOSURE)) {
+			if (proc->code)
+				navi_code_unref(proc->code);
+			proc->code = navi_compile(proc);
+		}
+
+		frame = make_frame(proc, args, env);
+		guard = navi_gc_guard(procedure_obj(proc));
+		navi_gc_check();
+		result = exec(proc->code->body, frame);
+		navi_gc_unguard(guard);
+		navi_env_unref(frame);
+
+		if (!is_tail_call(result))
+			return result;
+		proc = tail_call.proc;
+		args = tail_call.args;
+		env.lexical = proc->env;
+	}
+}
+/* Execution }}} */
+/* Compilation {{{ */
+static struct node *make_node(node_fn fn, enum node_type type, navi_obj form,
+		bool tail)
+{
+	struct node *node = navi_critical_malloc(sizeof(struct node));
+	memset(node, 0, sizeof(struct node));
+	node->fn = fn;
+	node->type = type;
+	node->tail = tail;
+	node->form = form;
+	return node;
+}
+
+static struct node **make_node_array(unsigned nr)
+{
+	return navi_critical_malloc(sizeof(struct node*) * (nr ? nr : 1));
+}
+
+static void free_node(struct node *node);
+static void free_function(struct vm_function *fn);
+
+static void free_node_array(struct node **nodes, unsigned nr)
+{
+	for (unsigned i = 0; i < nr; i++)
+		free_node(nodes[i]);
+	free(nodes);
+}
+
+static void free_node(struct node *node)
+{
+	if (!node)
+		return;
+	switch (node->type) {
+	case NODE_CONSTANT:
+	case NODE_REF:
+	case NODE_LOCAL_REF:
+	case NODE_EVAL:
+		break;
+	case NODE_LOCAL_SET:
+		free_node(node->local.value);
+		break;
+	case NODE_IF:
+		free_node(node->branch.test);
+		free_node(node->branch.consequent);
+		free_node(node->branch.alternative);
+		break;
+	case NODE_SEQUENCE:
+	case NODE_AND:
+	case NODE_OR:
+		free_node_array(node->seq.nodes, node->seq.nr);
+		break;
+	case NODE_DEFINE:
+	case NODE_SET:
+		free_node(node->assign.value);
+		break;
+	case NODE_LAMBDA:
+		if (node->lambda.anonymous)
+			navi_gc_release(node->lambda.name);
+		navi_code_unref(node->lambda.code);
+		break;
+	case NODE_LET:
+	case NODE_SEQUENTIAL_LET:
+		free(node->let.vars);
+		free_node_array(node->let.inits, node->let.nr);
+		free_node(node->let.body);
+		break;
+	case NODE_COND:
+		free_node_array(node->cond.tests, node->cond.nr);
+		free_node_array(node->cond.bodies, node->cond.nr);
+		break;
+	case NODE_CALL:
+		free_node(node->call.op);
+		free_node_array(node->call.args, node->call.nr);
+		break;
+	}
+	free(node);
+}
+
+static struct navi_code *make_code(enum navi_engine engine)
+{
+	struct navi_code *code = navi_critical_malloc(sizeof(struct navi_code));
+	code->refs = 1;
+	code->engine = engine;
+	code->nr_slots = 0;
+	code->names = NULL;
+	code->body = NULL;
+	return code;
+}
+
+struct navi_code *navi_code_ref(struct navi_code *code)
+{
+	code->refs++;
+	return code;
+}
+
+void navi_code_unref(struct navi_code *code)
+{
+	if (--code->refs)
+		return;
+	if (code->engine == NAVI_ENGINE_VM)
+		free_function(code->function);
+	else
+		free_node(code->body);
+	free(code->names);
+	free(code);
+}
+
+static bool scope_contains(struct cscope *scope, navi_obj var)
+{
+	for (unsigned i = 0; i < scope->nr; i++) {
+		if (scope->vars[i].p == var.p)
+			return true;
+	}
+	return false;
+}
+
+static void scope_add(struct cscope *scope, navi_obj var)
+{
+	if (scope->nr == scope->size) {
+		scope->size = scope->size ? scope->size * 2 : 8;
+		scope->vars = navi_critical_realloc(scope->vars,
+				sizeof(navi_obj) * scope->size);
+	}
+	scope->vars[scope->nr++] = var;
+}
+
+static void scope_add_formals(struct cscope *scope, navi_obj formals)
+{
+	navi_obj cons;
+	navi_list_for_each(cons, formals) {
+		scope_add(scope, navi_car(cons));
+	}
+	if (navi_is_symbol(cons))
+		scope_add(scope, cons);
+}
+
+static void push_scope(struct compiler *c, struct cscope *scope)
+{
+	scope->next = c->scope;
+	scope->nr = scope->size = 0;
+	scope->vars = NULL;
+	c->scope = scope;
+}
+
+/*
+ * Pop the current scope, returning its variables (which become the slot
+ * names of the corresponding frame).  The caller owns the returned array.
+ */
+static navi_obj *pop_scope(struct compiler *c, unsigned *nr_slots)
+{
+	navi_obj *vars = c->scope->vars;
+	*nr_slots = c->scope->nr;
+	c->scope = c->scope->next;
+	return vars;
+}
+
+/*
+ * Resolve @symbol to a frame slot.  Returns false if @symbol isn't bound by
+ * any enclosing frame (in which case it is looked up by name at run time).
+ */
+static bool resolve(struct compiler *c, navi_obj symbol, unsigned *depth,
+		unsigned *index)
+{
+	unsigned d = 0;
+	for (struct cscope *s = c->scope; s; s = s->next, d++) {
+		for (unsigned i = s->nr; i > 0; i--) {
+			if (s->vars[i-1].p == symbol.p) {
+				*depth = d;
+				*index = i-1;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static bool is_local(struct compiler *c, navi_obj symbol)
+{
+	unsigned depth, index;
+	return resolve(c, symbol, &depth, &index);
+}
+
+/*
+ * Returns the special form or macro bound to @symbol in the compile-time
+ * environment, or void if @symbol is not bound to syntax.
+ */
+static navi_obj lookup_syntax(struct compiler *c, navi_obj symbol)
+{
+	navi_obj val;
+	if (!navi_is_symbol(symbol) || is_local(c, symbol))
+		return navi_make_void();
+	val = navi_env_lookup(c->env, symbol);
+	if (navi_type(val) == NAVI_SPECIAL || navi_type(val) == NAVI_MACRO)
+		return val;
+	return navi_make_void();
+}
+
+static bool is_special(navi_obj obj, navi_builtin fn)
+{
+	return navi_type(obj) == NAVI_SPECIAL
+		&& navi_procedure(obj)->c_proc == fn;
+}
+
+/*
+ * Add the variables defined by the internal definitions in @body to the
+ * current scope, so that they shadow any syntax with the same name.
+ */
+static void scan_body(struct compiler *c, navi_obj body)
+{
+	navi_obj cons;
+	navi_list_for_each(cons, body) {
+		navi_obj syntax, target, form = navi_car(cons);
+		if (!navi_is_pair(form) || !navi_is_pair(navi_cdr(form)))
+			continue;
+		syntax = lookup_syntax(c, navi_car(form));
+		target = navi_cadr(form);
+		if (is_special(syntax, scm_define)) {
+			if (navi_is_pair(target))
+				target = navi_car(target);
+			if (navi_is_symbol(target) && !scope_contains(c->scope, target))
+				scope_add(c->scope, target);
+		} else if (is_special(syntax, scm_define_values)) {
+			navi_obj vars;
+			navi_list_for_each(vars, target) {
+				if (!scope_contains(c->scope, navi_car(vars)))
+					scope_add(c->scope, navi_car(vars));
+			}
+			if (navi_is_symbol(vars) && !scope_contains(c->scope, vars))
+				scope_add(c->scope, vars);
+		} else if (is_special(syntax, scm_begin)) {
+			scan_body(c, navi_cdr(form));
+		}
+	}
+}
+
+static struct node *compile(struct compiler *c, navi_obj expr, bool tail);
+
+static struct node *compile_eval(navi_obj form, bool tail)
+{
+	return make_node(exec_eval, NODE_EVAL, form, tail);
+}
+
+static struct node *compile_constant(navi_obj form, navi_obj value)
+{
+	struct node *node = make_node(exec_constant, NODE_CONSTANT, form, false);
+	node->constant = value;
+	return node;
+}
+
+static struct node *compile_ref(struct compiler *c, navi_obj symbol)
+{
+	struct node *node;
+	unsigned depth, index;
+
+	if (resolve(c, symbol, &depth, &index)) {
+		node = make_node(exec_local_ref, NODE_LOCAL_REF, symbol, false);
+		node->local.depth = depth;
+		node->local.index = index;
+		return node;
+	}
+	node = make_node(exec_ref, NODE_REF, symbol, false);
+	node->ref.symbol = symbol;
+	for (struct cscope *s = c->scope; s; s = s->next)
+		node->ref.depth++;
+	return node;
+}
+
+static struct node *compile_seq(struct compiler *c, node_fn fn,
+		enum node_type type, navi_obj form, navi_obj list, bool tail)
+{
+	navi_obj cons;
+	unsigned i = 0;
+	struct node *node = make_node(fn, type, form, tail);
+
+	node->seq.nr = navi_list_length(list);
+	node->seq.nodes = make_node_array(node->seq.nr);
+	navi_list_for_each(cons, list) {
+		bool last = navi_is_last_pair(cons);
+		node->seq.nodes[i++] = compile(c, navi_car(cons), tail && last);
+	}
+	return node;
+}
+
+static struct node *compile_body(struct compiler *c, navi_obj body, bool tail)
+{
+	return compile_seq(c, exec_sequence, NODE_SEQUENCE, body, body, tail);
+}
+
+/* (quote datum) */
+static struct node *compile_quote(struct compiler *c, navi_obj form, bool tail)
+{
+	if (navi_list_length(form) != 2)
+		return NULL;
+	return compile_constant(form, navi_cadr(form));
+}
+
+/* (if test consequent [alternative]) */
+static struct node *compile_if(struct compiler *c, navi_obj form, bool tail)
+{
+	struct node *node;
+	int length = navi_list_length(form);
+
+	if (length != 3 && length != 4)
+		return NULL;
+
+	node = make_node(exec_if, NODE_IF, form, tail);
+	node->branch.test = compile(c, navi_cadr(form), false);
+	node->branch.consequent = compile(c, navi_caddr(form), tail);
+	if (length == 4)
+		node->branch.alternative = compile(c, navi_cadddr(form), tail);
+	return node;
+}
+
+/* (begin expr ...) */
+static struct node *compile_begin(struct compiler *c, navi_obj form, bool tail)
+{
+	if (!navi_is_pair(navi_cdr(form)))
+		return NULL;
+	return compile_body(c, navi_cdr(form), tail);
+}
+
+static struct node *compile_and(struct compiler *c, navi_obj form, bool tail)
+{
+	return compile_seq(c, exec_and, NODE_AND, form, navi_cdr(form), tail);
+}
+
+static struct node *compile_or(struct compiler *c, navi_obj form, bool tail)
+{
+	return compile_seq(c, exec_or, NODE_OR, form, navi_cdr(form), tail);
+}
+
+static bool formals_valid(navi_obj formals)
+{
+	return navi_is_symbol(formals)
+		|| navi_is_list_of(formals, NAVI_SYMBOL, true);
+}
+
+static struct node *make_lambda(struct compiler *c, navi_obj form,
+		navi_obj formals, navi_obj body, navi_obj name)
+{
+	struct cscope scope;
+	struct navi_code *outer = c->code;
+	struct node *node = make_node(exec_lambda, NODE_LAMBDA, form, false);
+
+	node->lambda.args = formals;
+	node->lambda.body = body;
+	node->lambda.name = name;
+	node->lambda.code = c->code = make_code(NAVI_ENGINE_CLOSURE);
+
+	push_scope(c, &scope);
+	scope_add_formals(&scope, formals);
+	scan_body(c, body);
+	node->lambda.code->body = compile_body(c, body, true);
+	node->lambda.code->names = pop_scope(c, &node->lambda.code->nr_slots);
+	c->code = outer;
+	return node;
+}
+
+/* (lambda formals body ...) */
+static struct node *compile_lambda(struct compiler *c, navi_obj form, bool tail)
+{
+	struct node *node;
+	navi_obj rest = navi_cdr(form);
+	if (!navi_is_pair(rest) || !navi_is_pair(navi_cdr(rest)))
+		return NULL;
+	if (!formals_valid(navi_car(rest)))
+		return NULL;
+
+	/* the name isn't part of the source, so it must be kept alive here */
+	node = make_lambda(c, form, navi_car(rest), navi_cdr(rest),
+			navi_gc_protect(navi_make_lambda_name()));
+	node->lambda.anonymous = true;
+	return node;
+}
+
+static struct node *make_assign(struct compiler *c, node_fn fn,
+		enum node_type type, navi_obj form, navi_obj symbol,
+		struct node *value)
+{
+	struct node *node = make_node(fn, type, form, false);
+	node->assign.symbol = symbol;
+	node->assign.value = value;
+	return node;
+}
+
+static struct node *make_local_set(navi_obj form, unsigned depth,
+		unsigned index, struct node *value)
+{
+	struct node *node = make_node(exec_local_set, NODE_LOCAL_SET, form, false);
+	node->local.depth = depth;
+	node->local.index = index;
+	node->local.value = value;
+	return node;
+}
+
+/*
+ * A definition binds a slot in the current frame if the variable was found
+ * by scan_body; otherwise it is bound by name.
+ */
+static struct node *make_define(struct compiler *c, navi_obj form,
+		navi_obj symbol, struct node *value)
+{
+	unsigned depth, index;
+	if (resolve(c, symbol, &depth, &index) && depth == 0)
+		return make_local_set(form, depth, index, value);
+	return make_assign(c, exec_define, NODE_DEFINE, form, symbol, value);
+}
+
+/* (define var expr) or (define (var . formals) body ...) */
+static struct node *compile_define(struct compiler *c, navi_obj form, bool tail)
+{
+	navi_obj target, rest;
+
+	if (navi_list_length(form) < 3)
+		return NULL;
+
+	target = navi_cadr(form);
+	rest = navi_cddr(form);
+	if (navi_is_symbol(target)) {
+		if (!navi_is_nil(navi_cdr(rest)))
+			return NULL;
+		return make_define(c, form, target,
+				compile(c, navi_car(rest), false));
+	}
+	if (!navi_is_list_of(target, NAVI_SYMBOL, true))
+		return NULL;
+	return make_define(c, form, navi_car(target),
+			make_lambda(c, form, navi_cdr(target), rest,
+				navi_car(target)));
+}
+
+/* (set! var expr) */
+static struct node *compile_set(struct compiler *c, navi_obj form, bool tail)
+{
+	unsigned depth, index;
+	navi_obj var;
+
+	if (navi_list_length(form) != 3 || !navi_is_symbol(navi_cadr(form)))
+		return NULL;
+	var = navi_cadr(form);
+	if (resolve(c, var, &depth, &index))
+		return make_local_set(form, depth, index,
+				compile(c, navi_caddr(form), false));
+	return make_assign(c, exec_set, NODE_SET, form, var,
+			compile(c, navi_caddr(form), false));
+}
+
+static bool let_defs_valid(navi_obj defs)
+{
+	navi_obj cons;
+	navi_list_for_each(cons, defs) {
+		navi_obj def = navi_car(cons);
+		if (navi_list_length_safe(def) != 2 || !navi_is_symbol(navi_car(def)))
+			return false;
+	}
+	return navi_is_nil(cons);
+}
+
+/* (let ((var init) ...) body ...) and (let* ((var init) ...) body ...) */
+static struct node *compile_let(struct compiler *c, navi_obj form,
+		bool sequential, bool tail)
+{
+	navi_obj cons, defs;
+	unsigned i = 0;
+	struct node *node;
+	struct cscope scope;
+
+	if (navi_list_length(form) < 3 || !let_defs_valid(navi_cadr(form)))
+		return NULL;
+
+	defs = navi_cadr(form);
+	node = make_node(sequential ? exec_sequential_let : exec_let,
+			sequential ? NODE_SEQUENTIAL_LET : NODE_LET, form, tail);
+	node->let.nr = navi_list_length(defs);
+	node->let.code = c->code;
+	node->let.inits = make_node_array(node->let.nr);
+
+	/* let inits are evaluated in the enclosing scope */
+	if (!sequential) {
+		navi_list_for_each(cons, defs) {
+			node->let.inits[i++] = compile(c, navi_cadar(cons), false);
+		}
+	}
+	push_scope(c, &scope);
+	i = 0;
+	navi_list_for_each(cons, defs) {
+		/* let* inits are evaluated in the new scope */
+		if (sequential)
+			node->let.inits[i++] = compile(c, navi_cadar(cons), false);
+		scope_add(&scope, navi_caar(cons));
+	}
+	scan_body(c, navi_cddr(form));
+	node->let.body = compile_body(c, navi_cddr(form), tail);
+	node->let.vars = pop_scope(c, &node->let.nr_slots);
+	return node;
+}
+
+/* (cond (test expr ...) ... [(else expr ...)]) without '=>' clauses */
+static struct node *compile_cond(struct compiler *c, navi_obj form, bool tail)
+{
+	navi_obj cons, clauses = navi_cdr(form);
+	unsigned i = 0;
+	struct node *node;
+
+	if (!navi_is_pair(clauses))
+		return NULL;
+	navi_list_for_each(cons, clauses) {
+		navi_obj clause = navi_car(cons);
+		if (navi_list_length_safe(clause) < 2)
+			return NULL;
+		if (navi_symbol_eq(navi_cadr(clause), navi_sym_eq_lt))
+			return NULL;
+	}
+	if (!navi_is_nil(cons))
+		return NULL;
+
+	node = make_node(exec_cond, NODE_COND, form, tail);
+	node->cond.nr = navi_list_length(clauses);
+	node->cond.tests = make_node_array(node->cond.nr);
+	node->cond.bodies = make_node_array(node->cond.nr);
+	navi_list_for_each(cons, clauses) {
+		navi_obj clause = navi_car(cons);
+		if (navi_symbol_eq(navi_car(clause), navi_sym_else))
+			node->cond.tests[i] = NULL;
+		else
+			node->cond.tests[i] = compile(c, navi_car(clause), false);
+		node->cond.bodies[i++] = compile_body(c, navi_cdr(clause), tail);
+	}
+	return node;
+}
+
+static struct node *compile_call(struct compiler *c, navi_obj form, bool tail)
+{
+	navi_obj cons;
+	unsigned i = 0;
+	struct node *node = make_node(exec_call, NODE_CALL, form, tail);
+
+	node->call.op = compile(c, navi_car(form), false);
+	node->call.nr = navi_list_length(navi_cdr(form));
+	node->call.args = make_node_array(node->call.nr);
+	navi_list_for_each(cons, navi_cdr(form)) {
+		node->call.args[i++] = compile(c, navi_car(cons), false);
+	}
+	return node;
+}
+
+static const struct {
+	navi_builtin special;
+	struct node *(*compile)(struct compiler*, navi_obj, bool);
+} special_compilers[] = {
+	{ scm_quote,  compile_quote  },
+	{ scm_if,     compile_if     },
+	{ scm_begin,  compile_begin  },
+	{ scm_and,    compile_and    },
+	{ scm_or,     compile_or     },
+	{ scm_lambda, compile_lambda },
+	{ scm_define, compile_define },
+	{ scm_set,    compile_set    },
+	{ scm_cond,   compile_cond   },
+};
+
+static struct node *compile_special(struct compiler *c, navi_obj special,
+		navi_obj form, bool tail)
+{
+	struct node *node = NULL;
+	navi_builtin fn = navi_procedure(special)->c_proc;
+
+	if (fn == scm_let || fn == scm_sequential_let) {
+		node = compile_let(c, form, fn == scm_sequential_let, tail);
+		goto out;
+	}
+	for (size_t i = 0; i < sizeof(special_compilers)/sizeof(*special_compilers); i++) {
+		if (special_compilers[i].special == fn) {
+			node = special_compilers[i].compile(c, form, tail);
+			break;
+		}
+	}
+out:
+	/* malformed or unsupported: let the tree-walker deal with it */
+	return node ? node : compile_eval(form, tail);
+}
+
+static struct node *compile(struct compiler *c, navi_obj expr, bool tail)
+{
+	navi_obj syntax;
+
+	switch (navi_type(expr)) {
+	case NAVI_SYMBOL:
+		return compile_ref(c, expr);
+	case NAVI_PAIR:
+		if (!navi_is_proper_list(expr))
+			return compile_eval(expr, tail);
+		syntax = lookup_syntax(c, navi_car(expr));
+		if (navi_type(syntax) == NAVI_SPECIAL)
+			return compile_special(c, syntax, expr, tail);
+		if (navi_type(syntax) == NAVI_MACRO)
+			return compile_eval(expr, tail);
+		return compile_call(c, expr, tail);
+	case NAVI_VALUES:
+	case NAVI_THUNK:
+	case NAVI_BOUNCE:
+	case NAVI_TRAP:
+		return compile_eval(expr, tail);
+	default:
+		break;
+	}
+	return compile_constant(expr, expr);
+}
+
+struct navi_code *navi_compile(struct navi_procedure *proc)
+{
+	struct cscope scope;
+	struct navi_code *code = make_code(NAVI_ENGINE_CLOSURE);
+	struct compiler c = {
+		.env = proc->env,
+		.code = code,
+		.scope = NULL,
+	};
+
+	push_scope(&c, &scope);
+	scope_add_formals(&scope, proc->args);
+	scan_body(&c, proc->body);
+	code->body = compile_body(&c, proc->body, true);
+	code->names = pop_scope(&c, &code->nr_slots);
+	return code;
+}
+/* Compilation }}} */
+/* Bytecode generation {{{ */
+struct emitter {
+	struct vm_function *fn;
+	unsigned insns_size;
+	unsigned consts_size;
+	unsigned refs_size;
+	unsigned lambdas_size;
+	unsigned lets_size;
+	/* the number of values on the stack at the current instruction */
+	unsigned depth;
+};
+
+static void free_function(struct vm_function *fn)
+{
+	for (unsigned i = 0; i < fn->nr_lambdas; i++) {
+		if (fn->lambdas[i].anonymous)
+			navi_gc_release(fn->lambdas[i].name);
+		navi_code_unref(fn->lambdas[i].code);
+	}
+	for (unsigned i = 0; i < fn->nr_lets; i++)
+		free(fn->lets[i].names);
+	free(fn->insns);
+	free(fn->consts);
+	free(fn->refs);
+	free(fn->lambdas);
+	free(fn->lets);
+	free(fn);
+}
+
+/* Make room for element @nr of @array, which has room for @size elements. */
+static void *grow(void *array, unsigned nr, unsigned *size, size_t elm_size)
+{
+	if (nr < *size)
+		return array;
+	*size = *size ? *size * 2 : 8;
+	return navi_critical_realloc(array, elm_size * *size);
+}
+
+static unsigned emit(struct emitter *e, enum vm_opcode op, unsigned a,
+		unsigned b)
+{
+	struct vm_function *fn = e->fn;
+	fn->insns = grow(fn->insns, fn->nr_insns, &e->insns_size,
+			sizeof(struct vm_insn));
+	fn->insns[fn->nr_insns] = (struct vm_insn) { .op = op, .a = a, .b = b };
+	return fn->nr_insns++;
+}
+
+/* Point the jump at @insn to the next instruction. */
+static void patch(struct emitter *e, unsigned insn)
+{
+	e->fn->insns[insn].b = e->fn->nr_insns;
+}
+
+static unsigned add_const(struct emitter *e, navi_obj obj)
+{
+	struct vm_function *fn = e->fn;
+	fn->consts = grow(fn->consts, fn->nr_consts, &e->consts_size,
+			sizeof(navi_obj));
+	fn->consts[fn->nr_consts] = obj;
+	return fn->nr_consts++;
+}
+
+static unsigned add_ref(struct emitter *e, navi_obj symbol)
+{
+	struct vm_function *fn = e->fn;
+	fn->refs = grow(fn->refs, fn->nr_refs, &e->refs_size,
+			sizeof(struct vm_ref));
+	fn->refs[fn->nr_refs] = (struct vm_ref) { .symbol = symbol };
+	return fn->nr_refs++;
+}
+
+static void push(struct emitter *e, unsigned n)
+{
+	e->depth += n;
+	if (e->depth > e->fn->max_stack)
+		e->fn->max_stack = e->depth;
+}
+
+static void pop(struct emitter *e, unsigned n)
+{
+	e->depth -= n;
+}
+
+/*
+ * Emit an instruction which pushes a value.  In tail position, the value is
+ * then returned.
+ */
+static void emit_value(struct emitter *e, enum vm_opcode op, unsigned a,
+		unsigned b, bool tail)
+{
+	emit(e, op, a, b);
+	push(e, 1);
+	if (tail)
+		emit(e, VM_RETURN, 0, 0);
+}
+
+static struct navi_code *lower_code(struct navi_code *tree);
+static void lower(struct emitter *e, struct node *node, bool tail);
+
+/* Lower @node for its side effects only: nothing is left on the stack. */
+static void lower_effect(struct emitter *e, struct node *node)
+{
+	switch (node->type) {
+	case NODE_CONSTANT:
+		return;
+	case NODE_LOCAL_SET:
+		lower(e, node->local.value, false);
+		emit(e, VM_STORE_LOCAL, node->local.depth, node->local.index);
+		break;
+	case NODE_DEFINE:
+		lower(e, node->assign.value, false);
+		emit(e, VM_DEFINE, 0, add_const(e, node->assign.symbol));
+		break;
+	case NODE_SET:
+		lower(e, node->assign.value, false);
+		emit(e, VM_SET, 0, add_const(e, node->assign.symbol));
+		break;
+	default:
+		lower(e, node, false);
+		emit(e, VM_POP, 0, 0);
+		break;
+	}
+	pop(e, 1);
+}
+
+static void lower_if(struct emitter *e, struct node *node, bool tail)
+{
+	unsigned alternative, end = 0;
+
+	lower(e, node->branch.test, false);
+	alternative = emit(e, VM_JUMP_FALSE, 0, 0);
+	pop(e, 1);
+
+	lower(e, node->branch.consequent, tail);
+	if (!tail)
+		end = emit(e, VM_JUMP, 0, 0);
+	pop(e, 1);
+
+	patch(e, alternative);
+	if (node->branch.alternative)
+		lower(e, node->branch.alternative, tail);
+	else
+		emit_value(e, VM_VOID, 0, 0, tail);
+	if (!tail)
+		patch(e, end);
+}
+
+static void lower_sequence(struct emitter *e, struct node *node, bool tail)
+{
+	unsigned i;
+	for (i = 0; i < node->seq.nr - 1; i++)
+		lower_effect(e, node->seq.nodes[i]);
+	lower(e, node->seq.nodes[i], tail);
+}
+
+/*
+ * and/or: every operand but the last jumps to the end with @value if @jump
+ * is taken.
+ */
+static void lower_junction(struct emitter *e, struct node *node,
+		enum vm_opcode jump, bool value, bool tail)
+{
+	unsigned i, *jumps, end = 0, nr = node->seq.nr;
+
+	if (nr == 0) {
+		emit_value(e, VM_CONST, 0, add_const(e, navi_make_bool(!value)),
+				tail);
+		return;
+	}
+
+	jumps = navi_critical_malloc(sizeof(unsigned) * nr);
+	for (i = 0; i < nr - 1; i++) {
+		lower(e, node->seq.nodes[i], false);
+		jumps[i] = emit(e, jump, 0, 0);
+		pop(e, 1);
+	}
+	lower(e, node->seq.nodes[i], tail);
+	if (nr > 1) {
+		if (!tail)
+			end = emit(e, VM_JUMP, 0, 0);
+		pop(e, 1);
+		for (i = 0; i < nr - 1; i++)
+			patch(e, jumps[i]);
+		emit_value(e, VM_CONST, 0, add_const(e, navi_make_bool(value)),
+				tail);
+		if (!tail)
+			patch(e, end);
+	}
+	free(jumps);
+}
+
+static void lower_lambda(struct emitter *e, struct node *node, bool tail)
+{
+	struct vm_function *fn = e->fn;
+	struct vm_lambda *lambda;
+
+	fn->lambdas = grow(fn->lambdas, fn->nr_lambdas, &e->lambdas_size,
+			sizeof(struct vm_lambda));
+	lambda = &fn->lambdas[fn->nr_lambdas];
+	lambda->args = node->lambda.args;
+	lambda->body = node->lambda.body;
+	lambda->name = node->lambda.name;
+	lambda->anonymous = node->lambda.anonymous;
+	lambda->code = lower_code(node->lambda.code);
+
+	/* the (protected) name now belongs to the bytecode */
+	node->lambda.anonymous = false;
+	emit_value(e, VM_LAMBDA, 0, fn->nr_lambdas++, tail);
+}
+
+static void lower_let(struct emitter *e, struct node *node, bool tail)
+{
+	struct vm_function *fn = e->fn;
+	unsigned let = fn->nr_lets;
+
+	fn->lets = grow(fn->lets, fn->nr_lets, &e->lets_size,
+			sizeof(struct vm_let));
+	fn->lets[let].nr_slots = node->let.nr_slots;
+	fn->lets[let].names = node->let.vars;
+	node->let.vars = NULL;
+	fn->nr_lets++;
+
+	if (node->type == NODE_LET) {
+		for (unsigned i = 0; i < node->let.nr; i++)
+			lower(e, node->let.inits[i], false);
+		emit(e, VM_FRAME, node->let.nr, let);
+		pop(e, node->let.nr);
+	} else {
+		emit(e, VM_FRAME, 0, let);
+		for (unsigned i = 0; i < node->let.nr; i++) {
+			lower(e, node->let.inits[i], false);
+			emit(e, VM_STORE_LOCAL, 0, i);
+			pop(e, 1);
+		}
+	}
+	lower(e, node->let.body, tail);
+	if (!tail)
+		emit(e, VM_UNFRAME, 0, 0);
+}
+
+static void lower_cond(struct emitter *e, struct node *node, bool tail)
+{
+	unsigned i, nr_jumps = 0;
+	unsigned *jumps = navi_critical_malloc(sizeof(unsigned) * node->cond.nr);
+
+	for (i = 0; i < node->cond.nr; i++) {
+		unsigned next;
+		if (!node->cond.tests[i]) {
+			/* else clause */
+			lower(e, node->cond.bodies[i], tail);
+			goto out;
+		}
+		lower(e, node->cond.tests[i], false);
+		next = emit(e, VM_JUMP_FALSE, 0, 0);
+		pop(e, 1);
+		lower(e, node->cond.bodies[i], tail);
+		pop(e, 1);
+		if (!tail)
+			jumps[nr_jumps++] = emit(e, VM_JUMP, 0, 0);
+		patch(e, next);
+	}
+	emit_value(e, VM_VOID, 0, 0, tail);
+out:
+	for (i = 0; i < nr_jumps; i++)
+		patch(e, jumps[i]);
+	free(jumps);
+}
+
+static void lower_call(struct emitter *e, struct node *node, bool tail)
+{
+	lower(e, node->call.op, false);
+	for (unsigned i = 0; i < node->call.nr; i++)
+		lower(e, node->call.args[i], false);
+	emit(e, tail ? VM_TAIL_CALL : VM_CALL, node->call.nr,
+			add_const(e, node->form));
+	pop(e, node->call.nr);
+}
+
+/*
+ * Lower @node to bytecode which leaves its value on the stack or, in tail
+ * position, returns it.
+ */
+static void lower(struct emitter *e, struct node *node, bool tail)
+{
+	switch (node->type) {
+	case NODE_CONSTANT:
+		emit_value(e, VM_CONST, 0, add_const(e, node->constant), tail);
+		break;
+	case NODE_REF:
+		emit_value(e, VM_REF, node->ref.depth, add_ref(e, node->ref.symbol),
+				tail);
+		break;
+	case NODE_LOCAL_REF:
+		if (node->local.depth == 0)
+			emit_value(e, VM_LOCAL0, 0, node->local.index, tail);
+		else
+			emit_value(e, VM_LOCAL, node->local.depth,
+					node->local.index, tail);
+		break;
+	case NODE_LOCAL_SET:
+	case NODE_DEFINE:
+	case NODE_SET:
+		lower_effect(e, node);
+		emit_value(e, VM_VOID, 0, 0, tail);
+		break;
+	case NODE_IF:
+		lower_if(e, node, tail);
+		break;
+	case NODE_SEQUENCE:
+		lower_sequence(e, node, tail);
+		break;
+	case NODE_AND:
+		lower_junction(e, node, VM_JUMP_FALSE, false, tail);
+		break;
+	case NODE_OR:
+		lower_junction(e, node, VM_JUMP_TRUE, true, tail);
+		break;
+	case NODE_LAMBDA:
+		lower_lambda(e, node, tail);
+		break;
+	case NODE_LET:
+	case NODE_SEQUENTIAL_LET:
+		lower_let(e, node, tail);
+		break;
+	case NODE_COND:
+		lower_cond(e, node, tail);
+		break;
+	case NODE_CALL:
+		lower_call(e, node, tail);
+		break;
+	case NODE_EVAL:
+		if (tail) {
+			emit(e, VM_TAIL_EVAL, 0, add_const(e, node->form));
+			push(e, 1);
+		} else {
+			emit_value(e, VM_EVAL, 0, add_const(e, node->form), false);
+		}
+		break;
+	}
+}
+
+/*
+ * Generate bytecode from the closure tree @tree.  The frame names used by
+ * the tree are taken over by the bytecode.
+ */
+static struct navi_code *lower_code(struct navi_code *tree)
+{
+	struct navi_code *code = make_code(NAVI_ENGINE_VM);
+	struct emitter e = {
+		.fn = navi_critical_malloc(sizeof(struct vm_function)),
+	};
+
+	memset(e.fn, 0, sizeof(struct vm_function));
+	code->nr_slots = tree->nr_slots;
+	code->names = tree->names;
+	code->function = e.fn;
+	tree->names = NULL;
+
+	lower(&e, tree->body, true);
+	return code;
+}
+
+struct navi_code *navi_compile_bytecode(struct navi_procedure *proc)
+{
+	struct navi_code *tree = navi_compile(proc);
+	struct navi_code *code = lower_code(tree);
+	navi_code_unref(tree);
+	return code;
+}
+/* Bytecode generation }}} */
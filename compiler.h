@@ -14,6 +14,7 @@
 #ifdef __GNUC__
 #define _Noreturn __attribute__((noreturn))
 #define _Alignas(n) __attribute__((aligned(n)))
+#define _Thread_local __thread
 #else
 #define _Noreturn
 #define _Alignas(n)
@@ -26,6 +27,8 @@
 #define likely(x) __builtin_expect(!!(x), 1)
 /* Optimization: Condition @x is unlikely */
 #define unlikely(x) __builtin_expect(!!(x), 0)
+/* Optimization: Memory at @addr will be read soon */
+#define prefetch(addr) __builtin_prefetch(addr)
 
 #define __hot    __attribute__((hot))
 #define __const  __attribute__((const))
@@ -34,6 +37,7 @@
 #else
 #define likely(x) (x)
 #define unlikely(x) (x)
+#define prefetch(addr)
 
 #define __hot
 #define __const
@@ -50,27 +50,19 @@ DEFUN(procedurep, "procedure?", 1, 0, NAVI_ANY)
 
 DEFUN(apply, "apply", 2, NAVI_PROC_VARIADIC, NAVI_PROCEDURE, NAVI_ANY)
 {
-	navi_obj cons, last = scm_args;
-	navi_list_for_each(cons, scm_args) {
-		navi_obj fst = navi_car(cons);
-		/* walk to the last argument */
-		if (navi_type(navi_cdr(cons)) != NAVI_NIL) {
-			last = cons;
-			continue;
-		}
-		navi_type_check_proper_list(fst, scm_env);
-
-		/* flatten arg list */
-		navi_pair(last)->cdr = fst;
-		break;
-	}
-	return navi_apply(navi_procedure(scm_arg1), navi_cdr(scm_args), scm_env);
+	/* the last argument is a list of further arguments */
+	navi_obj args = scm_argv[scm_nr_args-1];
+	navi_type_check_proper_list(args, scm_env);
+	for (unsigned i = scm_nr_args - 1; i > 1; i--)
+		args = navi_make_pair(scm_argv[i-1], args);
+	return navi_apply(navi_procedure(scm_arg1), args, scm_env);
 }
 
 navi_obj navi_call_escape(navi_obj escape, navi_obj arg, navi_env env)
 {
 	struct navi_escape *esc = navi_escape(escape);
 	esc->arg = arg;
+	navi_gc_write_barrier(escape.p, arg);
 
 	// TODO: swap dynamic environment
 	// FIXME: the below *should* work (to prevent reference leaks), but
@@ -79,6 +71,7 @@ navi_obj navi_call_escape(navi_obj escape, navi_obj arg, navi_env env)
 	//        zero.  Further investigation required.  For now, call/ec
 	//        leaks memory.
 	//navi_env_unref(env);
+	navi_escape_unwind(esc);
 	longjmp(esc->state, 1);
 }
 
@@ -87,14 +80,15 @@ DEFUN(call_ec, "call/ec", 1, 0, NAVI_PROCEDURE)
 	navi_obj cont, result;
 	struct navi_escape *escape;
 	struct navi_procedure *proc = navi_procedure(scm_arg1);
-	struct navi_guard *guard = NULL;
+	size_t guard;
 
 	navi_check_arity(scm_arg1, 1, scm_env);
 
 	cont = navi_make_escape();
-	guard = navi_gc_guard(cont, scm_env);
+	guard = navi_gc_guard(cont);
 	escape = navi_escape(cont);
 	escape->env = scm_env;
+	escape->roots = navi_gc_roots();
 
 	navi_env_ref(scm_env);
 	if (setjmp(escape->state)) {
@@ -154,13 +148,13 @@ DEFUN(raise_continuable, "raise-continuable", 1, 0, NAVI_ANY)
 {
 	navi_obj handler, result;
 	struct navi_procedure *proc;
-	struct navi_guard *guard;
+	size_t guard;
 
 	handler = navi_env_lookup(scm_env.dynamic, navi_sym_current_exn);
 	if (!navi_is_procedure(handler))
 		unhandled_exception(scm_args, scm_env);
 
-	guard = navi_gc_guard(handler, scm_env);
+	guard = navi_gc_guard(handler);
 	proc = navi_procedure(handler);
 	navi_scope_unset(scm_env.dynamic, navi_sym_current_exn);
 	result = navi_apply(proc, scm_args, scm_env);
@@ -5,18 +5,6 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
-static struct navi_scope *internal_env = NULL;
-
-navi_obj navi_get_internal(navi_obj symbol, navi_env env)
-{
-	struct navi_binding *binding = navi_env_binding(internal_env, symbol);
-	if (unlikely(!binding))
-		navi_error(env, "no internal binding",
-				navi_make_apair("symbol", symbol));
-
-	return navi_from_spec(binding->object.v, navi_get_global_env(env));
-}
-
 /*
  * The top-level exception handler: prints a message and returns to the REPL.
  */
@@ -33,6 +21,7 @@ DEFUN(toplevel_exn, "#exn", 1, 0, NAVI_ANY)
 
 	navi_scope_set(scm_env.dynamic, navi_sym_current_exn,
 			navi_from_spec(&SCM_DECL(toplevel_exn), scm_env));
+	navi_escape_unwind(navi_escape(cont));
 	longjmp(navi_escape(cont)->state, 1);
 }
 
@@ -197,6 +186,8 @@ static const struct navi_spec *builtin_objects[] = {
 	DECL_SPEC(string_fill),
 	DECL_SPEC(string_copy),
 	DECL_SPEC(string_copy_to),
+	DECL_SPEC(string_to_symbol),
+	DECL_SPEC(symbol_to_string),
 
 	DECL_SPEC(vectorp),
 	DECL_SPEC(make_vector),
@@ -262,15 +253,90 @@ static const struct navi_spec *builtin_objects[] = {
 	DECL_SPEC(gc_collect),
 	DECL_SPEC(gc_count),
 	DECL_SPEC(gc_stats),
+	DECL_SPEC(gc_set_budget),
+	DECL_SPEC(gc_set_retention),
+	DECL_SPEC(gc_set_slab_arena),
 	NULL
 };
 
-void navi_internal_init(void)
+/*
+ * Builtin procedures are materialized the first time they are asked for and
+ * the same object is handed out from then on.  Parameters are the exception:
+ * making one binds its value in the dynamic environment, so each request
+ * gets a fresh parameter.  The cached objects are GC roots (see
+ * navi_builtins_mark).
+ */
+navi_obj navi_get_builtin(unsigned i, navi_env env)
+{
+	const struct navi_spec *spec = builtin_objects[i];
+	if (spec->type == NAVI_PARAMETER)
+		return navi_from_spec(spec, navi_get_global_env(env));
+	if (!_navi_vm->builtins[i].p)
+		_navi_vm->builtins[i] = navi_from_spec(spec,
+				navi_get_global_env(env));
+	return _navi_vm->builtins[i];
+}
+
+void navi_builtins_mark(void (*mark)(navi_obj))
 {
-	internal_env = _navi_make_scope();
 	for (int i = 0; builtin_objects[i]; i++) {
+		if (_navi_vm->builtins[i].p)
+			mark(_navi_vm->builtins[i]);
+	}
+}
+
+navi_obj navi_get_internal(navi_obj symbol, navi_env env)
+{
+	struct navi_binding *binding = navi_env_binding(_navi_vm->internal_env,
+			symbol);
+	if (unlikely(!binding))
+		navi_error(env, "no internal binding",
+				navi_make_apair("symbol", symbol));
+
+	return navi_get_builtin(navi_fixnum(binding->object), env);
+}
+
+/* Returns the name of the builtin at index @i, or NULL past the last one. */
+const char *navi_builtin_name(unsigned i)
+{
+	return builtin_objects[i] ? builtin_objects[i]->ident : NULL;
+}
+
+/*
+ * Returns the index of the builtin @obj was materialized from, or -1 if it
+ * wasn't.  A parameter is matched by its key, which is named after its spec.
+ */
+int navi_builtin_index(navi_obj obj)
+{
+	const char *name = NULL;
+	if (navi_type(obj) == NAVI_PARAMETER) {
+		navi_obj key = navi_parameter_key(obj);
+		if (!navi_symbol_is_interned(key))
+			return -1;
+		name = navi_symbol(key)->data;
+	}
+	for (int i = 0; builtin_objects[i]; i++) {
+		if (name) {
+			if (builtin_objects[i]->type == NAVI_PARAMETER
+					&& !strcmp(builtin_objects[i]->ident, name))
+				return i;
+		} else if (_navi_vm->builtins[i].p == obj.p) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void navi_internal_init(void)
+{
+	int nr = 0;
+	while (builtin_objects[nr])
+		nr++;
+	_navi_vm->builtins = navi_critical_malloc(nr * sizeof(navi_obj));
+	_navi_vm->internal_env = _navi_make_scope();
+	for (int i = 0; i < nr; i++) {
 		navi_obj symbol = navi_gc_protect(navi_make_symbol(builtin_objects[i]->ident));
-		navi_obj object = (navi_obj) { .v = (void*) builtin_objects[i] };
-		navi_scope_set(internal_env, symbol, object);
+		_navi_vm->builtins[i].p = NULL;
+		navi_scope_set(_navi_vm->internal_env, symbol, navi_make_fixnum(i));
 	}
 }
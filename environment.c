@@ -7,9 +7,6 @@
 
 #include "default_bindings.c"
 
-NAVI_LIST_HEAD(active_environments, navi_scope) active_environments
-	= NAVI_LIST_HEAD_INITIALIZER(active_environments);
-
 static unsigned long ptr_hash(navi_obj ptr)
 {
 	return ptr.n;
@@ -18,7 +15,7 @@ static unsigned long ptr_hash(navi_obj ptr)
 static struct navi_bucket *get_bucket(struct navi_scope *scope,
 		unsigned long hashcode)
 {
-	return &scope->bindings[hashcode % NAVI_ENV_HT_SIZE];
+	return &scope->bindings[hashcode & scope->hash_mask];
 }
 
 static struct navi_binding *scope_lookup(struct navi_scope *scope,
@@ -34,11 +31,28 @@ static struct navi_binding *scope_lookup(struct navi_scope *scope,
 	return NULL;
 }
 
+/*
+ * Returns the index of the slot named @symbol in the frame @scope, or -1.
+ * Later slots shadow earlier ones (let* may bind the same name twice).
+ */
+static int frame_lookup(struct navi_scope *scope, navi_obj symbol)
+{
+	for (int i = scope->nr_slots - 1; i >= 0; i--) {
+		if (scope->names[i].p == symbol.p)
+			return i;
+	}
+	return -1;
+}
+
 struct navi_binding *navi_scope_lookup(struct navi_scope *scope, navi_obj symbol)
 {
 	return scope_lookup(scope, symbol, ptr_hash(symbol));
 }
 
+/*
+ * Returns the named binding for @symbol in @env.  Frame slots are not
+ * bindings; use navi_env_cell() to look up lexical variables.
+ */
 __hot struct navi_binding *navi_env_binding(struct navi_scope *env, navi_obj symbol)
 {
 	struct navi_binding *binding;
@@ -52,32 +66,206 @@ __hot struct navi_binding *navi_env_binding(struct navi_scope *env, navi_obj sym
 	return NULL;
 }
 
+/*
+ * Returns a pointer to the location holding the value of @symbol in @env, or
+ * NULL if @symbol is unbound.
+ */
+__hot navi_obj *navi_env_cell(struct navi_scope *env, navi_obj symbol)
+{
+	struct navi_binding *binding;
+	unsigned long hashcode = ptr_hash(symbol);
+
+	for (struct navi_scope *s = env; s; s = s->next) {
+		int i = frame_lookup(s, symbol);
+		if (i >= 0)
+			return &s->slots[i];
+		binding = scope_lookup(s, symbol, hashcode);
+		if (binding != NULL)
+			return &binding->object;
+	}
+	return NULL;
+}
+
+/*
+ * Look up @symbol in @env, and cache its binding if it was found in @global,
+ * the scope above the frames of the calling code (see navi_env_cached_cell).
+ */
+navi_obj *_navi_env_cached_cell(struct navi_scope *env,
+		struct navi_scope *global, navi_obj symbol,
+		struct navi_ref_cache *cache)
+{
+	struct navi_binding *binding;
+	navi_obj *cell = navi_env_cell(env, symbol);
+
+	if (cell == NULL || global->next != NULL)
+		return cell;
+	binding = navi_scope_lookup(global, symbol);
+	if (binding == NULL || &binding->object != cell)
+		return cell;
+
+	cache->version = _navi_vm->env_version;
+	cache->scope = global;
+	cache->binding = binding;
+	return cell;
+}
+
+/*
+ * Adding or removing a binding in a global scope or a compiled frame may
+ * change what a cached reference resolves to.  Other scopes are never
+ * between a cached reference and its global scope.
+ */
+static inline void scope_changed(struct navi_scope *scope)
+{
+	if (scope->next == NULL || scope->code != NULL)
+		_navi_vm->env_version++;
+}
+
+static void scope_init(struct navi_scope *s)
+{
+	s->next = NULL;
+	s->names = NULL;
+	s->code = NULL;
+	s->nr_slots = 0;
+}
+
 struct navi_scope *_navi_make_scope(void)
 {
 	struct navi_scope *s = navi_critical_malloc(sizeof(struct navi_scope));
+	scope_init(s);
+	s->bindings = navi_critical_malloc(sizeof(struct navi_bucket)
+			* NAVI_ENV_HT_SIZE);
+	s->hash_mask = NAVI_ENV_HT_SIZE - 1;
 	for (unsigned int i = 0; i < NAVI_ENV_HT_SIZE; i++)
 		NAVI_LIST_INIT(&s->bindings[i]);
-	NAVI_LIST_INIT(&s->guards);
-	s->next = NULL;
 	return s;
 }
 
+static void register_scope(struct navi_scope *scope)
+{
+	NAVI_LIST_INSERT_HEAD(&_navi_vm->environments, scope, link);
+	scope->refs = 1;
+}
+
 struct navi_scope *navi_make_scope(void)
 {
 	struct navi_scope *scope = _navi_make_scope();
-	NAVI_LIST_INSERT_HEAD(&active_environments, scope, link);
-	scope->refs = 1;
+	register_scope(scope);
 	return scope;
 }
 
-navi_env navi_env_new_scope(navi_env env)
+/* Set up the environment registry and library table of the current VM. */
+void navi_env_init(void)
 {
-	struct navi_scope *scope = navi_make_scope();
+	NAVI_LIST_INIT(&_navi_vm->environments);
+	for (int i = 0; i < NAVI_ENV_HT_SIZE; i++)
+		NAVI_LIST_INIT(&_navi_vm->libraries[i]);
+}
+
+static void free_scope(struct navi_scope *scope)
+{
+	if (!navi_scope_is_frame(scope))
+		free(scope->bindings);
+	if (scope->code)
+		navi_code_unref(scope->code);
+	free(scope);
+}
+
+/*
+ * Free every scope and library of the current VM, whatever their reference
+ * counts.  Bindings are left to be freed with their slab cache.
+ */
+void navi_env_free_all(void)
+{
+	struct navi_scope *scope;
+	struct navi_library *lib, *n;
+	while ((scope = NAVI_LIST_FIRST(&_navi_vm->environments))) {
+		NAVI_LIST_REMOVE(scope, link);
+		free_scope(scope);
+	}
+	free_scope(_navi_vm->internal_env);
+	for (int i = 0; i < NAVI_FRAME_CACHE_SLOTS; i++) {
+		while ((scope = _navi_vm->free_frames[i])) {
+			_navi_vm->free_frames[i] = scope->next;
+			free(scope);
+		}
+		_navi_vm->nr_free_frames[i] = 0;
+	}
+	for (int i = 0; i < NAVI_ENV_HT_SIZE; i++) {
+		NAVI_LIST_FOREACH_SAFE(lib, &_navi_vm->libraries[i], link, n)
+			free(lib);
+	}
+}
+
+/*
+ * A frame is created and freed on every call to a compiled procedure, so
+ * freed frames with few slots are kept on per-size lists for reuse rather
+ * than returned to malloc.  Each list is bounded, so that unwinding a deep
+ * recursion doesn't keep all of its frames.
+ */
+#define FRAME_CACHE_DEPTH 64
+
+static struct navi_scope *alloc_frame(unsigned nr_slots)
+{
+	struct navi_scope *s;
+	if (nr_slots < NAVI_FRAME_CACHE_SLOTS
+			&& (s = _navi_vm->free_frames[nr_slots])) {
+		_navi_vm->free_frames[nr_slots] = s->next;
+		_navi_vm->nr_free_frames[nr_slots]--;
+		return s;
+	}
+	return navi_critical_malloc(sizeof(struct navi_scope)
+			+ sizeof(navi_obj) * nr_slots);
+}
+
+/* Free a frame which is no longer referenced (see navi_scope_free). */
+void navi_free_frame(struct navi_scope *frame)
+{
+	unsigned n = frame->nr_slots;
+	if (n < NAVI_FRAME_CACHE_SLOTS
+			&& _navi_vm->nr_free_frames[n] < FRAME_CACHE_DEPTH) {
+		frame->next = _navi_vm->free_frames[n];
+		_navi_vm->free_frames[n] = frame;
+		_navi_vm->nr_free_frames[n]++;
+		return;
+	}
+	free(frame);
+}
+
+static struct navi_scope *make_frame(struct navi_code *code, unsigned nr_slots,
+		const navi_obj *names)
+{
+	struct navi_scope *s = alloc_frame(nr_slots);
+	scope_init(s);
+	s->bindings = &s->frame_bindings;
+	s->hash_mask = 0;
+	NAVI_LIST_INIT(&s->frame_bindings);
+	s->nr_slots = nr_slots;
+	s->names = names;
+	s->code = code ? navi_code_ref(code) : NULL;
+	for (unsigned i = 0; i < nr_slots; i++)
+		s->slots[i] = navi_make_void();
+	register_scope(s);
+	return s;
+}
+
+/*
+ * Create a frame with @nr_slots slots named by @names as a child of @env.
+ * The slots are initially unbound; @names belongs to @code.
+ */
+navi_env navi_env_new_frame(navi_env env, struct navi_code *code,
+		unsigned nr_slots, const navi_obj *names)
+{
+	struct navi_scope *scope = make_frame(code, nr_slots, names);
 	navi_env_ref(env);
 	scope->next = env.lexical;
 	return (navi_env) { .lexical = scope, .dynamic = env.dynamic };
 }
 
+navi_env navi_env_new_scope(navi_env env)
+{
+	return navi_env_new_frame(env, NULL, 0, NULL);
+}
+
 navi_env navi_dynamic_env_new_scope(navi_env env)
 {
 	struct navi_scope *scope = navi_make_scope();
@@ -86,28 +274,16 @@ navi_env navi_dynamic_env_new_scope(navi_env env)
 	return (navi_env) { .lexical = env.lexical, .dynamic = scope };
 }
 
-void env_set(navi_env env, navi_obj symbol, navi_obj object)
-{
-	struct navi_binding *binding;
-	struct navi_bucket *head;
-
-	binding = navi_env_binding(env.lexical, symbol);
-	if (binding) {
-		binding->object = object;
-		return;
-	}
-
-	/* FIXME: hash() already computed in navi_env_binding */
-	head = get_bucket(env.lexical, ptr_hash(symbol));
-	binding = navi_make_binding(symbol, object);
-	NAVI_LIST_INSERT_HEAD(head, binding, link);
-}
-
 void navi_scope_set(struct navi_scope *env, navi_obj symbol, navi_obj object)
 {
+	int i;
 	struct navi_binding *binding;
 	unsigned long hashcode = ptr_hash(symbol);
 
+	if ((i = frame_lookup(env, symbol)) >= 0) {
+		env->slots[i] = object;
+		return;
+	}
 	if ((binding = scope_lookup(env, symbol, hashcode)) != NULL) {
 		binding->object = object;
 		return;
@@ -115,17 +291,24 @@ void navi_scope_set(struct navi_scope *env, navi_obj symbol, navi_obj object)
 
 	binding = navi_make_binding(symbol, object);
 	NAVI_LIST_INSERT_HEAD(get_bucket(env, hashcode), binding, link);
+	scope_changed(env);
 }
 
 int navi_scope_unset(struct navi_scope *env, navi_obj symbol)
 {
+	int i;
 	struct navi_binding *binding;
 	unsigned long hashcode = ptr_hash(symbol);
 
+	if ((i = frame_lookup(env, symbol)) >= 0) {
+		env->slots[i] = navi_make_void();
+		return 1;
+	}
 	if ((binding = scope_lookup(env, symbol, hashcode)) == NULL)
 		return 0;
 
 	NAVI_LIST_REMOVE(binding, link);
+	scope_changed(env);
 	return 1;
 }
 
@@ -147,11 +330,9 @@ navi_env navi_extend_environment(navi_env env, navi_obj vars, navi_obj args)
 
 static void navi_import_all(struct navi_scope *dst, struct navi_scope *src)
 {
-	for (unsigned i = 0; i < NAVI_ENV_HT_SIZE; i++) {
-		struct navi_binding *binding;
-		NAVI_LIST_FOREACH(binding, &src->bindings[i], link) {
-			navi_scope_set(dst, binding->symbol, binding->object);
-		}
+	struct navi_binding *binding;
+	navi_scope_for_each(binding, src) {
+		navi_scope_set(dst, binding->symbol, binding->object);
 	}
 }
 
@@ -388,15 +569,15 @@ DEFLET(let_values, "let-values", letvals_defs_valid, letvals_extend_env)
 
 DEFSPECIAL(set, "set!", 2, 0, NAVI_SYMBOL, NAVI_ANY)
 {
-	struct navi_binding *binding;
+	navi_obj *cell;
 	navi_obj value;
 
-	binding = navi_env_binding(scm_env.lexical, scm_arg1);
-	if (unlikely(!binding))
+	cell = navi_env_cell(scm_env.lexical, scm_arg1);
+	if (unlikely(!cell))
 		navi_unbound_identifier_error(scm_env, scm_arg1);
 
 	value = navi_eval(scm_arg2, scm_env);
-	binding->object = value;
+	*cell = value;
 
 	return navi_unspecified();
 }
@@ -426,7 +607,7 @@ navi_obj navi_parameter_convert(navi_obj param, navi_obj obj, navi_env env)
 navi_obj navi_make_parameter(navi_obj value, navi_obj converter, navi_env env)
 {
 	navi_obj param = _navi_make_parameter(converter);
-	struct navi_guard *guard = navi_gc_guard(param, env);
+	size_t guard = navi_gc_guard(param);
 	navi_scope_set(get_global_scope(env.dynamic), navi_parameter_key(param),
 			navi_parameter_convert(param, value, env));
 	navi_gc_unguard(guard);
@@ -437,7 +618,7 @@ navi_obj navi_make_named_parameter(navi_obj symbol, navi_obj value,
 		navi_obj converter, navi_env env)
 {
 	navi_obj param = _navi_make_named_parameter(symbol, converter);
-	struct navi_guard *guard = navi_gc_guard(param, env);
+	size_t guard = navi_gc_guard(param);
 	navi_scope_set(get_global_scope(env.dynamic), navi_parameter_key(param),
 			navi_parameter_convert(param, value, env));
 	navi_gc_unguard(guard);
@@ -457,6 +638,7 @@ DEFUN(make_parameter, "make-parameter", 1, NAVI_PROC_VARIADIC, NAVI_ANY)
 static navi_env parameterize_extend_env(navi_obj defs, navi_env env)
 {
 	navi_env new;
+	size_t guard = navi_gc_roots();
 	navi_obj cons, params = navi_make_nil();
 	if (unlikely(!navi_is_pair(defs)))
 		navi_error(env, "invalid syntax in parameterize");
@@ -470,6 +652,8 @@ static navi_env parameterize_extend_env(navi_obj defs, navi_env env)
 		if (unlikely(!navi_is_parameter(param)))
 			navi_error(env, "non-parameter in parameterize");
 		params = navi_make_pair(navi_make_pair(param, navi_cadr(def)), params);
+		navi_gc_unguard(guard);
+		navi_gc_guard(params);
 	}
 	if (unlikely(!navi_is_nil(cons)))
 		navi_error(env, "not a proper list");
@@ -483,6 +667,7 @@ static navi_env parameterize_extend_env(navi_obj defs, navi_env env)
 		val = navi_parameter_convert(param, val, env);
 		navi_scope_set(new.dynamic, navi_parameter_key(param), val);
 	}
+	navi_gc_unguard(guard);
 	return new;
 }
 
@@ -497,16 +682,6 @@ DEFSPECIAL(parameterize, "parameterize", 2, NAVI_PROC_VARIADIC,
 
 /* Dynamic Bindings }}} */
 /* Libraries {{{ */
-static bool libraries_initialized = false;
-static NAVI_LIST_HEAD(lib_bucket, navi_library) libraries[NAVI_ENV_HT_SIZE];
-
-static void libraries_init(void)
-{
-	for (int i = 0; i < NAVI_ENV_HT_SIZE; i++)
-		NAVI_LIST_INIT(&libraries[i]);
-	libraries_initialized = true;
-}
-
 static unsigned long libname_hash(navi_obj name)
 {
 	navi_obj cons;
@@ -527,25 +702,21 @@ static bool libname_equal(navi_obj a, navi_obj b)
 	return navi_is_nil(cons_a) && navi_is_nil(cons_b);
 }
 
-static struct lib_bucket *lib_bucket(unsigned long hash)
+static struct navi_lib_bucket *lib_bucket(unsigned long hash)
 {
-	return &libraries[hash % NAVI_ENV_HT_SIZE];
+	return &_navi_vm->libraries[hash % NAVI_ENV_HT_SIZE];
 }
 
 static struct navi_library *register_library(struct navi_library *lib)
 {
-	if (!libraries_initialized)
-		libraries_init();
 	NAVI_LIST_INSERT_HEAD(lib_bucket(libname_hash(lib->name)), lib, link);
 	return lib;
 }
 
 static struct navi_library *find_library(navi_obj name)
 {
-	if (!libraries_initialized)
-		libraries_init();
 	struct navi_library *entry;
-	struct lib_bucket *bucket = lib_bucket(libname_hash(name));
+	struct navi_lib_bucket *bucket = lib_bucket(libname_hash(name));
 	NAVI_LIST_FOREACH(entry, bucket, link) {
 		if (libname_equal(entry->name, name))
 			return entry;
@@ -785,14 +956,6 @@ static char *libname_to_path(const char *base, navi_obj name)
 	return path;
 }
 
-static navi_obj open_lib_file(const char *base, navi_obj name)
-{
-	char *path = libname_to_path(base, name);
-	navi_obj port = _navi_open_input_file(path);
-	free(path);
-	return port;
-}
-
 static bool is_libdef(navi_obj obj)
 {
 	return navi_is_pair(obj)
@@ -800,14 +963,26 @@ static bool is_libdef(navi_obj obj)
 		&& navi_car(obj).p == navi_sym_deflib.p;
 }
 
-static struct navi_library *try_read_library(const char *path, navi_obj name,
+/*
+ * Read the definition of the library @name under the directory @base, from
+ * the library cache if it's up to date and otherwise from the source file.
+ */
+static struct navi_library *try_read_library(const char *base, navi_obj name,
 		navi_env env)
 {
-	navi_obj defn, port;
-	port = open_lib_file(path, name);
-	if (navi_is_void(port))
-		return NULL;
-	defn = navi_read(navi_port(port), env);
+	char *path = libname_to_path(base, name);
+	navi_obj defn = navi_read_cached_library(path, env);
+	if (navi_is_void(defn)) {
+		navi_obj port = _navi_open_input_file(path);
+		if (navi_is_void(port)) {
+			free(path);
+			return NULL;
+		}
+		defn = navi_read(navi_port(port), env);
+		if (is_libdef(defn))
+			navi_cache_library(path, defn, env);
+	}
+	free(path);
 	if (unlikely(!is_libdef(defn)))
 		navi_error(env, "error reading library",
 				navi_make_apair("library", name));
@@ -893,6 +1068,33 @@ static struct navi_library *load_library(navi_obj name, navi_env env)
 	return do_load_library(lib, env);
 }
 
+/*
+ * Register a library which is already loaded, with an empty environment for
+ * the caller to fill in.  Used to restore libraries from a heap image.
+ */
+struct navi_library *navi_make_loaded_library(navi_obj name, navi_obj exports,
+		navi_env env)
+{
+	struct navi_library *lib = register_library(make_library(name,
+				navi_make_nil()));
+	lib->loaded = true;
+	lib->exports = exports;
+	lib->env = new_lexical_environment(env);
+	return lib;
+}
+
+/* Mark the names and declarations or exports of every library. */
+void navi_library_mark(void (*mark)(navi_obj))
+{
+	struct navi_library *lib;
+	for (int i = 0; i < NAVI_ENV_HT_SIZE; i++) {
+		NAVI_LIST_FOREACH(lib, &_navi_vm->libraries[i], link) {
+			mark(lib->name);
+			mark(lib->loaded ? lib->exports : lib->declarations);
+		}
+	}
+}
+
 /*
  * Import the object bound to @lib_name in @lib as @export_name in @env.
  */
@@ -1108,13 +1310,12 @@ navi_env navi_interaction_environment(void)
 DEFUN(env_list, "env-list", 0, 0)
 {
 	struct navi_scope *it;
-	struct navi_guard *guard;
 	struct navi_binding *bind;
-	NAVI_LIST_FOREACH(it, &active_environments, link) {
+	NAVI_LIST_FOREACH(it, &_navi_vm->environments, link) {
 		printf("Scope <%p> (%u refs):\n", (void*)it, it->refs);
-		NAVI_LIST_FOREACH(guard, &it->guards, link) {
-			printf("\tguarded: ");
-			navi_display(guard->obj, scm_env);
+		for (unsigned i = 0; i < it->nr_slots; i++) {
+			printf("\t%s: ", navi_symbol(it->names[i])->data);
+			navi_display(it->slots[i], scm_env);
 			putchar('\n');
 		}
 		navi_scope_for_each(bind, it) {
@@ -1130,7 +1331,7 @@ DEFUN(env_count, "env-count", 0, 0)
 {
 	unsigned i = 0;
 	struct navi_scope *it;
-	NAVI_LIST_FOREACH(it, &active_environments, link) {
+	NAVI_LIST_FOREACH(it, &_navi_vm->environments, link) {
 		i++;
 	}
 	printf("nr active environments = %u\n", i);
@@ -1141,7 +1342,7 @@ DEFUN(env_show, "env-show", 0, 0)
 {
 	int total = 0;
 	struct navi_scope *head, *it;
-	NAVI_LIST_FOREACH(head, &active_environments, link) {
+	NAVI_LIST_FOREACH(head, &_navi_vm->environments, link) {
 		printf("<%p/%u> ", (void*)head, head->refs);
 		for (it = head->next; it; it = it->next) {
 			printf("-> <%p/%u> ", (void*)it, it->refs);
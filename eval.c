@@ -5,6 +5,18 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
+void navi_set_engine(enum navi_engine engine)
+{
+	_navi_vm->engine = engine;
+}
+
+/* the value returned in place of a bounced expression (see navi_make_bounce) */
+struct navi_object _navi_bounce = {
+	.type = NAVI_BOUNCE,
+	.flags = NAVI_GC_OLD | NAVI_GC_MARK,
+	.size_class = SIZE_MALLOC,
+};
+
 static inline navi_obj eval_tail(navi_obj tail, navi_env env)
 {
 	return navi_make_bounce(tail, env);
@@ -71,7 +83,7 @@ navi_obj navi_load(navi_obj filename, bool ci, navi_env in_env, navi_env out_env
 	// FIXME: need to protect unbound object from gc somehow...
 	navi_obj port_obj = navi_open_input_file(filename, out_env);
 	struct navi_port *port = navi_port(port_obj);
-	struct navi_guard *guard = navi_gc_guard(port_obj, out_env);
+	size_t guard = navi_gc_guard(port_obj);
 
 	navi_port_set_fold_case(port, ci);
 	// read/eval until EOF with 1 expr lookahead for tail call
@@ -125,10 +137,25 @@ DEFSPECIAL(unquote, "unquote", 1, 0, NAVI_ANY)
 	return navi_eval(scm_arg1, scm_env);
 }
 
+/*
+ * Append @tail to the list being built by eval_qq.  The list is guarded once
+ * it has a head, since the remaining elements are evaluated as it grows.
+ */
+static void qq_append(struct navi_pair *head, struct navi_pair *last,
+		navi_obj tail)
+{
+	last->cdr = tail;
+	if (last == head)
+		navi_gc_guard(tail);
+	else
+		navi_gc_write_barrier(navi_object(last), tail);
+}
+
 /* FIXME: this is incredibly ugly */
 static navi_obj eval_qq(navi_obj expr, navi_env env)
 {
 	struct navi_pair head, *last;
+	size_t guard = navi_gc_roots();
 	navi_obj cons;
 
 	switch (navi_type(expr)) {
@@ -136,28 +163,38 @@ static navi_obj eval_qq(navi_obj expr, navi_env env)
 		if (navi_symbol_eq(navi_car(expr), navi_sym_unquote))
 			return scm_unquote(1, navi_cdr(expr), env, NULL);
 
+		head.cdr = navi_make_nil();
 		last = &head;
 		navi_list_for_each(cons, expr) {
 			navi_obj elm = navi_car(cons);
 			if (navi_is_pair(elm) && navi_symbol_eq(navi_car(elm), navi_sym_splice)) {
 				navi_obj list = scm_unquote(1, navi_cdar(cons), env, NULL);
-				if (navi_is_proper_list(list)) {
-					last->cdr = list;
+				if (navi_is_proper_list(list) && !navi_is_nil(list)) {
+					qq_append(&head, last, list);
 					last = navi_pair(navi_last_cons(list));
 				} // TODO: otherwise... ???
 			} else if (navi_symbol_eq(elm, navi_sym_unquote)) {
 				/* unquote in dotted tail */
 				break;
 			} else {
-				last->cdr = navi_make_empty_pair();
+				qq_append(&head, last, navi_make_empty_pair());
 				last = navi_pair(last->cdr);
 				last->car = eval_qq(navi_car(cons), env);
+				navi_gc_write_barrier(navi_object(last), last->car);
 			}
 		}
-		last->cdr = navi_is_nil(cons) ? navi_make_nil() : eval_qq(cons, env);
+		if (navi_is_nil(cons))
+			last->cdr = navi_make_nil();
+		else
+			qq_append(&head, last, eval_qq(cons, env));
+		navi_gc_unguard(guard);
 		return head.cdr;
 	case NAVI_VECTOR:
-		return navi_list_to_vector(eval_qq(navi_vector_to_list(expr), env));
+		cons = navi_vector_to_list(expr);
+		navi_gc_guard(cons);
+		cons = eval_qq(cons, env);
+		navi_gc_unguard(guard);
+		return navi_list_to_vector(cons);
 	default: break;
 	}
 	return expr;
@@ -192,7 +229,7 @@ static navi_obj eval_clause(navi_obj arg, navi_obj begin, navi_env env)
 		navi_obj call = navi_make_pair(proc, navi_make_pair(arg, navi_make_nil()));
 		return eval_tail(call, env);
 	}
-	return scm_begin(0, begin, env, NULL);
+	return scm_argv_begin(0, NULL, begin, env, NULL);
 }
 
 DEFSPECIAL(case, "case", 2, NAVI_PROC_VARIADIC, NAVI_ANY, NAVI_ANY)
@@ -302,6 +339,7 @@ DEFUN(force, "force", 1, 0, NAVI_PROCEDURE)
 	navi_env env = { .lexical = proc->env, .dynamic = scm_env.dynamic };
 	navi_obj r = navi_eval(navi_make_pair(navi_sym_begin, proc->body), env);
 	proc->body = navi_make_pair(navi_sym_quote, navi_make_pair(r, navi_make_nil()));
+	navi_gc_write_barrier(scm_arg1.p, proc->body);
 	return r;
 }
 
@@ -310,50 +348,70 @@ static __hot navi_obj do_apply(struct navi_procedure *proc, unsigned nr_args,
 {
 	navi_obj result;
 	if (navi_proc_is_builtin(proc)) {
-		struct navi_guard *guard = navi_gc_guard(args, env);
+		size_t guard = navi_gc_guard(args);
 		result = proc->c_proc(nr_args, args, env, proc);
 		navi_gc_unguard(guard);
+	} else if (_navi_vm->engine == NAVI_ENGINE_VM) {
+		result = navi_vm_apply(proc, args, env);
+	} else if (_navi_vm->engine == NAVI_ENGINE_CLOSURE) {
+		result = navi_code_apply(proc, args, env);
 	} else {
 		navi_env new = navi_extend_environment(env, proc->args, args);
-		result = scm_begin(0, proc->body, new, NULL);
+		result = scm_argv_begin(0, NULL, proc->body, new, NULL);
 		navi_env_unref(new);
 	}
-	struct navi_guard *guard = navi_gc_guard(result, env);
+	size_t guard = navi_gc_guard(result);
 	navi_gc_check();
 	navi_gc_unguard(guard);
 	return result;
 }
 
+static inline void check_type(int type, navi_obj obj, navi_env env)
+{
+	switch (type) {
+	case NAVI_LIST:
+		navi_type_check_list(obj, env);
+		break;
+	case NAVI_PROPER_LIST:
+		navi_type_check_proper_list(obj, env);
+		break;
+	case NAVI_BYTE:
+		navi_type_check_byte(obj, env);
+		break;
+	case NAVI_ANY:
+		break;
+	default:
+		navi_type_check(obj, type, env);
+	}
+}
+
+/*
+ * Count the arguments and check their types in one pass.  Arity errors take
+ * precedence over type errors, so the first mistyped argument is only
+ * reported once the count is known to be right.
+ */
 static unsigned check_apply(struct navi_procedure *proc, navi_obj args,
 		navi_env env)
 {
-	unsigned nr_args = navi_list_length(args);
-	if (unlikely(!navi_arity_satisfied(proc, nr_args)))
-		navi_arity_error(env, proc->name);
-	if (proc->types) {
-		navi_obj cons;
-		unsigned i = 0;
-		navi_list_for_each(cons, args) {
-			if (i >= proc->arity)
-				break;
-			switch (proc->types[i]) {
-			case NAVI_LIST:
-				navi_type_check_list(navi_car(cons), env);
-				break;
-			case NAVI_PROPER_LIST:
-				navi_type_check_proper_list(navi_car(cons), env);
-				break;
-			case NAVI_BYTE:
-				navi_type_check_byte(navi_car(cons), env);
-				break;
-			case NAVI_ANY:
-				break;
-			default:
-				navi_type_check(navi_car(cons), proc->types[i], env);
-			}
-			i++;
+	navi_obj cons, bad;
+	uint32_t checks = proc->checks;
+	unsigned nr_args = 0, bad_i = 0;
+	bool ok = true;
+
+	navi_list_for_each(cons, args) {
+		if ((checks & 1) && ok
+				&& !navi_type_ok(proc->types[nr_args], navi_car(cons))) {
+			bad = navi_car(cons);
+			bad_i = nr_args;
+			ok = false;
 		}
+		checks >>= 1;
+		nr_args++;
 	}
+	if (unlikely(!navi_arity_satisfied(proc, nr_args)))
+		navi_arity_error(env, proc->name);
+	if (unlikely(!ok))
+		check_type(proc->types[bad_i], bad, env);
 	return nr_args;
 }
 
@@ -362,19 +420,83 @@ navi_obj _navi_apply(struct navi_procedure *proc, navi_obj args, navi_env env)
 	return do_apply(proc, check_apply(proc, args, env), args, env);
 }
 
+navi_obj _navi_apply_argv(struct navi_procedure *proc, unsigned argc,
+		const navi_obj *argv, navi_env env)
+{
+	navi_obj result;
+	size_t guard;
+
+	if (!proc->c_argv)
+		return _navi_apply(proc, navi_list_from_argv(argc, argv), env);
+
+	if (unlikely(!navi_arity_satisfied(proc, argc)))
+		navi_arity_error(env, proc->name);
+	for (uint32_t checks = proc->checks, i = 0; checks; checks >>= 1, i++) {
+		if ((checks & 1) && unlikely(!navi_type_ok(proc->types[i], argv[i])))
+			check_type(proc->types[i], argv[i], env);
+	}
+
+	result = proc->c_argv(argc, argv, navi_make_void(), env, proc);
+	guard = navi_gc_guard(result);
+	navi_gc_check();
+	navi_gc_unguard(guard);
+	return result;
+}
+
+navi_obj _navi_call_argv(navi_builtin_argv fn, unsigned argc, unsigned copy,
+		navi_obj args, navi_env env, struct navi_procedure *proc)
+{
+	navi_obj cons, result, buf[NAVI_ARGV_MAX], *argv = buf;
+	size_t guard = navi_gc_roots();
+	unsigned i = 0;
+
+	if (copy > NAVI_ARGV_MAX) {
+		navi_obj vec = navi_make_vector(copy);
+		navi_gc_guard(vec);
+		argv = navi_vector(vec)->data;
+	}
+	navi_list_for_each(cons, args) {
+		if (i >= copy)
+			break;
+		argv[i++] = navi_car(cons);
+	}
+
+	result = fn(argc, argv, args, env, proc);
+	navi_gc_unguard(guard);
+	return result;
+}
+
+/*
+ * Builtins are passed their arguments on the C stack; everything else gets
+ * a list.
+ */
 static navi_obj procedure_call(struct navi_procedure *proc, navi_obj args,
 		navi_env env)
 {
-	navi_obj cons;
+	navi_obj cons, argv[NAVI_ARGV_MAX];
 	struct navi_pair head, *ptr = &head;
-	struct navi_guard *guard = NULL;
+	size_t guard = navi_gc_roots();
+	unsigned argc = 0;
+
+	if (proc->c_argv && navi_list_length(args) <= NAVI_ARGV_MAX) {
+		navi_list_for_each(cons, args) {
+			argv[argc] = navi_eval(navi_car(cons), env);
+			navi_gc_guard(argv[argc++]);
+		}
+		navi_obj result = navi_apply_argv(proc, argc, argv, env);
+		navi_gc_unguard(guard);
+		return result;
+	}
 
 	navi_list_for_each(cons, args) {
 		ptr->cdr = navi_make_pair(navi_make_void(), navi_make_nil());
 		if (ptr == &head)
-			guard = navi_gc_guard(ptr->cdr, env);
+			navi_gc_guard(ptr->cdr);
+		else
+			navi_gc_write_barrier(navi_object(ptr), ptr->cdr);
 		ptr = navi_pair(ptr->cdr);
 		ptr->car = navi_eval(navi_car(cons), env);
+		navi_gc_write_barrier(navi_object(ptr), ptr->car);
 	}
 	ptr->cdr = navi_make_nil();
 
@@ -395,40 +517,44 @@ static navi_obj caselambda_call(navi_obj lambda, navi_obj args, navi_env env)
 	navi_arity_error(env, navi_make_symbol("case-lambda"));
 }
 
-static navi_obj eval_call(navi_obj call, navi_env env)
+/*
+ * Call @proc, the value of the operator of @call.
+ */
+navi_obj navi_dispatch_call(navi_obj proc, navi_obj call, navi_env env)
 {
-	navi_obj obj, proc = navi_eval(navi_car(call), env);
-	struct navi_guard *guard = navi_gc_guard(proc, env);
+	navi_obj obj;
 	switch (navi_type(proc)) {
 	// special: pass args unevaluated, return result
 	case NAVI_SPECIAL:
-		obj = _navi_apply(navi_procedure(proc), navi_cdr(call), env);
-		break;
+		return _navi_apply(navi_procedure(proc), navi_cdr(call), env);
 	// procedure: pass args evaluated, return result
 	case NAVI_PROCEDURE:
-		obj = procedure_call(navi_procedure(proc), navi_cdr(call), env);
-		break;
+		return procedure_call(navi_procedure(proc), navi_cdr(call), env);
 	// macro: pass args unevaluated, return eval(result)
 	case NAVI_MACRO:
-		obj = eval_tail(_navi_apply(navi_procedure(proc), navi_cdr(call), env), env);
-		break;
+		obj = _navi_apply(navi_procedure(proc), navi_cdr(call), env);
+		return eval_tail(navi_force_tail(obj, env), env);
 	// escape: magic
 	case NAVI_ESCAPE:
 		obj = navi_list_length(call) < 2 ? navi_make_nil() : navi_cadr(call);
-		obj = navi_call_escape(proc, obj, env);
-		break;
+		return navi_call_escape(proc, obj, env);
 	// caselambda: magic
 	case NAVI_CASELAMBDA:
-		obj = caselambda_call(proc, navi_cdr(call), env);
-		break;
+		return caselambda_call(proc, navi_cdr(call), env);
 	case NAVI_PARAMETER:
 		if (unlikely(!navi_is_nil(navi_cdr(call))))
 			navi_arity_error(env, navi_car(proc));
-		obj = navi_parameter_lookup(proc, env);
-		break;
+		return navi_parameter_lookup(proc, env);
 	default:
 		navi_error(env, "call of non-procedure", navi_make_apair("value", proc));
 	}
+}
+
+static navi_obj eval_call(navi_obj call, navi_env env)
+{
+	navi_obj obj, proc = navi_eval(navi_car(call), env);
+	size_t guard = navi_gc_guard(proc);
+	obj = navi_dispatch_call(proc, call, env);
 	navi_gc_unguard(guard);
 	return obj;
 }
@@ -458,8 +584,9 @@ static __hot navi_obj _eval(navi_obj expr, navi_env env)
 	case NAVI_ENVIRONMENT:
 		return expr;
 	case NAVI_THUNK:
-	case NAVI_BOUNCE:
 		return _eval(navi_thunk(expr)->expr, navi_thunk(expr)->env);
+	case NAVI_BOUNCE:
+		return expr;
 	case NAVI_VALUES:
 		return navi_vector_ref(expr, 0);
 	case NAVI_SYMBOL:
@@ -478,16 +605,24 @@ static __hot navi_obj _eval(navi_obj expr, navi_env env)
 	return navi_unspecified();
 }
 
+/*
+ * The trampoline: a bounced expression is evaluated here, in the bounce's
+ * environment, whose reference is handed over with it.
+ */
 __hot navi_obj navi_eval(navi_obj expr, navi_env env)
 {
 	navi_env_ref(env);
-	do {
-		struct navi_guard *guard = navi_gc_guard(expr, env);
+	for (;;) {
+		size_t guard = navi_gc_guard(expr);
 		expr = _eval(expr, env);
 		navi_gc_unguard(guard);
-	} while (navi_is_bounce(expr));
-	navi_env_unref(env);
-	return expr;
+		navi_env_unref(env);
+		if (!navi_is_bounce(expr))
+			return expr;
+		expr = _navi_vm->bounce.expr;
+		env = _navi_vm->bounce.env;
+		_navi_vm->bounce.expr = navi_make_void();
+	}
 }
 
 DEFUN(eval, "eval", 1, 0, NAVI_ANY)
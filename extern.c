@@ -126,7 +126,8 @@ navi_obj navi_extern_env_lookup(struct navi_scope *scope, navi_obj symbol)
 navi_obj navi_extern_apply(struct navi_procedure *proc, navi_obj args,
 		navi_env env)
 {
-	return navi_apply(proc, args, env);
+	// a bounce only lasts until the next evaluation, so don't hand it out
+	return navi_force_tail(navi_apply(proc, args, env), env);
 }
 
 enum navi_type navi_extern_type(navi_obj obj)
@@ -5,55 +5,52 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
+#include <time.h>
+#include <sys/time.h>
 #include "slab.h"
 
-#define SYMTAB_SIZE 64
-
-extern NAVI_LIST_HEAD(active_environments, navi_scope) active_environments;
-static NAVI_SLIST_HEAD(heap, navi_object) heap = NAVI_SLIST_HEAD_INITIALIZER(heap);
-static NAVI_LIST_HEAD(sym_bucket, navi_symbol) symbol_table[SYMTAB_SIZE];
-
-static struct slab_cache *pair_cache = NULL;
-static struct slab_cache *thunk_cache = NULL;
-static struct slab_cache *guard_cache = NULL;
-static struct slab_cache *binding_cache = NULL;
-
-navi_obj navi_sym_begin;
-navi_obj navi_sym_quote;
-navi_obj navi_sym_quasiquote;
-navi_obj navi_sym_unquote;
-navi_obj navi_sym_splice;
-navi_obj navi_sym_else;
-navi_obj navi_sym_eq_lt;
-navi_obj navi_sym_lib_paths;
-navi_obj navi_sym_command_line;
-navi_obj navi_sym_current_exn;
-navi_obj navi_sym_current_input;
-navi_obj navi_sym_current_output;
-navi_obj navi_sym_current_error;
-navi_obj navi_sym_read_error;
-navi_obj navi_sym_file_error;
-navi_obj navi_sym_internal_error;
-navi_obj navi_sym_repl;
-navi_obj navi_sym_export;
-navi_obj navi_sym_import;
-navi_obj navi_sym_only;
-navi_obj navi_sym_except;
-navi_obj navi_sym_prefix;
-navi_obj navi_sym_rename;
-navi_obj navi_sym_deflib;
-navi_obj navi_sym_include;
-navi_obj navi_sym_include_ci;
-navi_obj navi_sym_include_libdecl;
-navi_obj navi_sym_cond_expand;
-navi_obj navi_sym_ellipsis;
-navi_obj navi_sym_underscore;
-
-static struct {
-	size_t bytes;
-	size_t objects;
-	size_t threshold;
-} gc_stats = {0};
+/* a minor collection is due after this many bytes have been allocated */
+#define NURSERY_SIZE (128 * 1024)
+
+#define SMALL_OBJECT_MIN 16
+#define SMALL_OBJECT_MAX 256
+
+/*
+ * The heap is split into two generations: new objects go into the nursery,
+ * and objects which survive a collection are promoted to the old generation.
+ * Objects never move in memory (C code holds raw references to them), so
+ * promoting an object just means setting NAVI_GC_OLD in its flags.
+ *
+ * Objects aren't linked together.  Pairs and thunks are found by sweeping
+ * their slab caches: minor collections sweep the slabs which have been
+ * allocated from since the last one, and major collections sweep them all.
+ * Other objects are allocated with malloc; young ones are kept in the
+ * nursery list, and old ones in the large-object registry.
+ *
+ * Old objects which may point into the nursery are kept in the remembered
+ * set (see navi_gc_write_barrier).
+ *
+ * Each VM has a heap of its own.  The names below refer to the parts of the
+ * current VM's heap.
+ */
+#define nursery       (_navi_vm->heap.nursery)
+#define large         (_navi_vm->heap.large)
+#define remembered    (_navi_vm->heap.remembered)
+#define symbol_table  (_navi_vm->heap.symbols)
+#define object_caches (_navi_vm->heap.caches)
+#define binding_cache (_navi_vm->heap.binding_cache)
+#define stats         (_navi_vm->heap.stats)
+#define gc_phase      (_navi_vm->heap.phase)
+#define gc_minor      (_navi_vm->heap.minor)
+#define gc_budget     (_navi_vm->heap.budget)
+#define gc_retention  (_navi_vm->heap.retention)
+#define gc_next_check (_navi_vm->heap.next_check)
+#define gray          (_navi_vm->heap.gray)
+#define mark_stack    (_navi_vm->heap.mark_stack)
+#define gc_roots      (_navi_vm->heap.roots)
+#define sweep         (_navi_vm->heap.sweep)
+
+_Thread_local struct navi_vm *_navi_vm;
 
 void *navi_critical_malloc(size_t size)
 {
@@ -76,11 +73,12 @@ static navi_obj to_obj(struct navi_object *obj)
 	return (navi_obj) { .p = obj };
 }
 
-static __const size_t object_size(struct navi_object *obj)
+static __const size_t data_size(struct navi_object *obj)
 {
 	switch(obj->type) {
 	case NAVI_VOID: case NAVI_NIL:  case NAVI_FIXNUM:
 	case NAVI_EOF:  case NAVI_BOOL: case NAVI_CHAR:
+	case NAVI_BOUNCE:
 		return 0;
 	case NAVI_PAIR:
 	case NAVI_PARAMETER:
@@ -88,10 +86,10 @@ static __const size_t object_size(struct navi_object *obj)
 	case NAVI_PORT:
 		return sizeof(struct navi_port);
 	case NAVI_STRING:
-		return navi_string(to_obj(obj))->capacity
-			+ sizeof(struct navi_string);
+		// large strings keep their data in a separate buffer
+		return sizeof(struct navi_string);
 	case NAVI_SYMBOL:
-		return strlen(navi_symbol(to_obj(obj))->data)
+		return strlen(navi_symbol(to_obj(obj))->data) + 1
 			+ sizeof(struct navi_symbol);
 	case NAVI_VECTOR:
 	case NAVI_VALUES:
@@ -99,7 +97,7 @@ static __const size_t object_size(struct navi_object *obj)
 		return navi_vector(to_obj(obj))->size * sizeof(navi_obj)
 			+ sizeof(struct navi_vector);
 	case NAVI_BYTEVEC:
-		return navi_bytevec(to_obj(obj))->size
+		return navi_bytevec(to_obj(obj))->size + 1
 			+ sizeof(struct navi_bytevec);
 	case NAVI_MACRO:
 	case NAVI_SPECIAL:
@@ -107,7 +105,6 @@ static __const size_t object_size(struct navi_object *obj)
 	case NAVI_PROCEDURE:
 		return sizeof(struct navi_procedure);
 	case NAVI_THUNK:
-	case NAVI_BOUNCE:
 		return sizeof(struct navi_thunk);
 	case NAVI_ESCAPE:
 		return sizeof(struct navi_escape);
@@ -119,6 +116,14 @@ static __const size_t object_size(struct navi_object *obj)
 	return 0;
 }
 
+/* The number of bytes allocated for @obj, including its header. */
+static size_t object_size(struct navi_object *obj)
+{
+	if (obj->size_class != SIZE_MALLOC)
+		return object_caches[obj->size_class]->obj_size;
+	return sizeof(struct navi_object) + data_size(obj);
+}
+
 /*void dprint(navi_obj obj)
 {
 	static navi_obj port = { .n = NAVI_VOID_TAG };
@@ -126,58 +131,160 @@ static __const size_t object_size(struct navi_object *obj)
 	if (navi_is_void(port)) {
 		env = navi_empty_environment();
 		port = navi_make_file_output_port(stdout);
-		navi_gc_guard(port, env);
+		navi_gc_protect(port);
 	}
 	navi_port_write(navi_port(port), obj, env);
 }*/
 
-static __hot void navi_free(struct navi_object *obj)
+static void object_list_push(struct navi_object_list *list,
+		struct navi_object *obj)
 {
-	gc_stats.bytes -= sizeof(struct navi_object) + object_size(obj);
-	gc_stats.objects--;
-	switch (obj->type) {
-	case NAVI_PAIR:
-	case NAVI_PARAMETER:
-		navi_slab_free(pair_cache, obj);
+	if (unlikely(list->nr == list->size)) {
+		list->size = list->size ? list->size * 2 : 64;
+		list->objects = navi_critical_realloc(list->objects,
+				sizeof(struct navi_object*) * list->size);
+	}
+	list->objects[list->nr++] = obj;
+}
+
+/* Returns the slab cache @obj was allocated from, or NULL. */
+static inline struct slab_cache *object_cache(struct navi_object *obj)
+{
+	return object_caches[obj->size_class];
+}
+
+/*
+ * Interned symbols are kept in an open-addressing table with linear probing,
+ * indexed by the hash stored in each symbol.  The table doubles when it is
+ * three quarters full.  Removal shifts the rest of the probe sequence back
+ * instead of leaving a tombstone.
+ *
+ * The table is weak: it doesn't keep its symbols alive, and a symbol is
+ * removed when the collector frees it.  A major cycle shrinks the table
+ * once it's less than an eighth full.
+ */
+#define SYMTAB_MIN_SIZE 256
+
+/* Returns the slot holding the symbol named @str, or the empty slot ending
+ * its probe sequence. */
+static inline size_t symtab_probe(const char *str, uint32_t length,
+		uint32_t hash)
+{
+	struct navi_symbol *it;
+	size_t i = hash & symbol_table.mask;
+	while ((it = symbol_table.slots[i])) {
+		if (it->hash == hash && it->length == length
+				&& !memcmp(it->data, str, length))
+			break;
+		i = (i + 1) & symbol_table.mask;
+	}
+	return i;
+}
+
+static navi_obj gc_keep_symbol(struct navi_symbol *symbol);
+
+static void symtab_resize(size_t size)
+{
+	struct navi_symbol **old = symbol_table.slots;
+	size_t old_size = symbol_table.mask + 1;
+	symbol_table.mask = size - 1;
+	symbol_table.slots = navi_critical_malloc(size * sizeof(*old));
+	memset(symbol_table.slots, 0, size * sizeof(*old));
+	for (size_t i = 0; i < old_size; i++) {
+		if (!old[i])
+			continue;
+		size_t j = old[i]->hash & symbol_table.mask;
+		while (symbol_table.slots[j])
+			j = (j + 1) & symbol_table.mask;
+		symbol_table.slots[j] = old[i];
+	}
+	free(old);
+}
+
+static void symtab_shrink(void)
+{
+	size_t size = symbol_table.mask + 1;
+	if (size <= SYMTAB_MIN_SIZE || symbol_table.nr * 8 >= size)
 		return;
+	while (size > SYMTAB_MIN_SIZE && symbol_table.nr * 4 < size)
+		size /= 2;
+	symtab_resize(size);
+}
+
+static void symtab_remove(struct navi_symbol *symbol)
+{
+	size_t mask = symbol_table.mask;
+	size_t i = symbol->hash & mask;
+	while (symbol_table.slots[i] != symbol)
+		i = (i + 1) & mask;
+	symbol_table.slots[i] = NULL;
+	symbol_table.nr--;
+	symbol->interned = false;
+
+	// move back entries which can no longer be reached from their home
+	for (size_t j = (i + 1) & mask; symbol_table.slots[j];
+			j = (j + 1) & mask) {
+		size_t home = symbol_table.slots[j]->hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			symbol_table.slots[i] = symbol_table.slots[j];
+			symbol_table.slots[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+/* Release the resources held by @obj, except for its memory. */
+static __hot void navi_finalize(struct navi_object *obj)
+{
+	stats.bytes -= object_size(obj);
+	stats.objects--;
+	switch (obj->type) {
 	case NAVI_THUNK:
-	case NAVI_BOUNCE:
 		navi_env_unref(navi_thunk(to_obj(obj))->env);
-		navi_slab_free(thunk_cache, obj);
-		return;
+		break;
 	case NAVI_PROCEDURE:
 		_navi_scope_unref(navi_procedure(to_obj(obj))->env);
+		/* fallthrough */
+	case NAVI_MACRO:
+	case NAVI_PROMISE:
+		if (navi_procedure(to_obj(obj))->code)
+			navi_code_unref(navi_procedure(to_obj(obj))->code);
 		break;
 	case NAVI_ENVIRONMENT:
 		navi_env_unref(navi_environment(to_obj(obj)));
 		break;
+	case NAVI_STRING:
+		if (!navi_string_is_inline(navi_string(to_obj(obj))))
+			free(navi_string(to_obj(obj))->data);
+		break;
 	case NAVI_SYMBOL:
 		// remove interned symbols from symbol table
 		if (navi_symbol_is_interned(to_obj(obj)))
-			NAVI_LIST_REMOVE(navi_symbol(to_obj(obj)), link);
+			symtab_remove(navi_symbol(to_obj(obj)));
 		break;
 	default:
 		break;
 	}
 	obj->type = NAVI_TRAP;
-	free(obj);
 }
 
-static __hot __const unsigned long symbol_hash(const char *symbol)
+static __hot void navi_free(struct navi_object *obj)
 {
-	unsigned long hash = 5381;
-	int c;
-
-	while ((c = *symbol++))
-		hash = ((hash << 5) + hash) ^ c; // hash * 33 ^ c
-
-	return hash;
+	struct slab_cache *cache = object_cache(obj);
+	navi_finalize(obj);
+	if (cache)
+		navi_slab_free(cache, obj);
+	else
+		free(obj);
 }
 
 static void symbol_table_init(void)
 {
-	for (unsigned i = 0; i < SYMTAB_SIZE; i++)
-		NAVI_LIST_INIT(&symbol_table[i]);
+	symbol_table.mask = SYMTAB_MIN_SIZE - 1;
+	symbol_table.slots = navi_critical_malloc(SYMTAB_MIN_SIZE
+			* sizeof(*symbol_table.slots));
+	memset(symbol_table.slots, 0, SYMTAB_MIN_SIZE
+			* sizeof(*symbol_table.slots));
 
 	#define intern(cname, name) \
 		navi_gc_protect((cname = navi_make_symbol(name)))
@@ -214,74 +321,89 @@ static void symbol_table_init(void)
 	#undef intern
 }
 
-void navi_init(void)
-{
-	pair_cache = navi_slab_cache_create(
-		sizeof(struct navi_object) + sizeof(struct navi_pair), 0);
-	thunk_cache = navi_slab_cache_create(
-		sizeof(struct navi_object) + sizeof(struct navi_thunk), 0);
-	guard_cache = navi_slab_cache_create(
-		sizeof(struct navi_guard), NAVI_SLAB_DOUBLY_LINKED);
+static void heap_init(void)
+{
+	// pairs and thunks are the bulk of the heap: give them huge arenas
+	object_caches[SIZE_PAIR] = navi_slab_cache_create(
+		sizeof(struct navi_object) + sizeof(struct navi_pair),
+		NAVI_SLAB_SWEPT, HUGE_PAGE_SIZE);
+	object_caches[SIZE_THUNK] = navi_slab_cache_create(
+		sizeof(struct navi_object) + sizeof(struct navi_thunk),
+		NAVI_SLAB_SWEPT, HUGE_PAGE_SIZE);
+	for (size_t i = SIZE_16, size = SMALL_OBJECT_MIN; i <= SIZE_256;
+			i++, size *= 2)
+		object_caches[i] = navi_slab_cache_create(size,
+				NAVI_SLAB_SWEPT, 0);
 	binding_cache = navi_slab_cache_create(
-		sizeof(struct navi_binding), NAVI_SLAB_DOUBLY_LINKED);
+		sizeof(struct navi_binding), NAVI_SLAB_DOUBLY_LINKED, 0);
 	symbol_table_init();
-	navi_internal_init();
 }
 
-static navi_obj symbol_lookup(const char *str, unsigned long hashcode)
+static void register_object(struct navi_object *obj, enum navi_type type,
+		enum size_class size_class, size_t size)
 {
-	struct navi_symbol *it;
-	struct sym_bucket *head = &symbol_table[hashcode % SYMTAB_SIZE];
-
-	NAVI_LIST_FOREACH(it, head, link) {
-		if (!strcmp(it->data, str))
-			return to_obj(navi_object(it));
-	}
-	return navi_make_void();
+	obj->type = type;
+	obj->flags = 0;
+	obj->size_class = size_class;
+	stats.bytes += size;
+	stats.nursery_bytes += size;
+	stats.objects++;
 }
 
-static void register_object(struct navi_object *obj, size_t size)
+static navi_obj slab_make_object(enum size_class size_class,
+		enum navi_type type)
 {
-	NAVI_SLIST_INSERT_HEAD(&heap, obj, link);
-	gc_stats.bytes += size;
-	gc_stats.objects++;
+	struct slab_cache *cache = object_caches[size_class];
+	struct navi_object *obj = navi_slab_alloc(cache);
+	register_object(obj, type, size_class, cache->obj_size);
+	return to_obj(obj);
 }
 
-static navi_obj slab_make_object(struct slab_cache *cache, enum navi_type type)
+/* The smallest power-of-two size class that fits an object of @size bytes. */
+static enum size_class small_size_class(size_t size)
 {
-	struct navi_object *obj = navi_slab_alloc(cache);
-	obj->type = type;
-	register_object(obj, cache->obj_size);
-	return to_obj(obj);
+	enum size_class size_class = SIZE_16;
+	for (size_t n = SMALL_OBJECT_MIN; n < size; n *= 2)
+		size_class++;
+	return size_class;
 }
 
 static navi_obj make_object(enum navi_type type, size_t size)
 {
-	struct navi_object *obj = navi_critical_malloc(sizeof(struct navi_object) + size);
-	obj->type = type;
-	register_object(obj, sizeof(struct navi_object) + size);
+	size += sizeof(struct navi_object);
+	if (size <= SMALL_OBJECT_MAX)
+		return slab_make_object(small_size_class(size), type);
+
+	struct navi_object *obj = navi_critical_malloc(size);
+	register_object(obj, type, SIZE_MALLOC, size);
+	object_list_push(&nursery, obj);
 	return to_obj(obj);
 }
 
-navi_obj navi_make_uninterned(const char *str)
+static navi_obj make_symbol(const char *str, size_t length, uint32_t hash)
 {
-	size_t len = strlen(str);
 	navi_obj obj = make_object(NAVI_SYMBOL,
-			sizeof(struct navi_symbol) + len + 1);
+			sizeof(struct navi_symbol) + length + 1);
 	struct navi_symbol *symbol = navi_symbol(obj);
-
-	for (size_t i = 0; i < len+1; i++)
-		symbol->data[i] = str[i];
-	symbol->link.le_prev = NULL;
+	symbol->hash = hash;
+	symbol->length = length;
+	symbol->interned = false;
+	memcpy(symbol->data, str, length);
+	symbol->data[length] = '\0';
 	return obj;
 }
 
+navi_obj navi_make_uninterned(const char *str)
+{
+	size_t length = strlen(str);
+	return make_symbol(str, length, navi_symbol_hash(str, length));
+}
+
 DEFUN(gensym, "gensym", 0, 0)
 {
 	char buf[64];
-	static unsigned count = 0;
 
-	snprintf(buf, 64, "g%u", count++);
+	snprintf(buf, 64, "g%u", _navi_vm->gensyms++);
 	buf[63] = '\0';
 	return navi_make_uninterned(buf);
 }
@@ -301,27 +423,39 @@ navi_obj _navi_make_named_parameter(navi_obj symbol, navi_obj converter)
 navi_obj _navi_make_parameter(navi_obj converter)
 {
 	char buf[64];
-	static unsigned count = 0;
-	snprintf(buf, 64, "param%u", count++);
+	snprintf(buf, 64, "param%u", _navi_vm->parameters++);
 	buf[63] = '\0';
 	return _navi_make_named_parameter(navi_make_uninterned(buf), converter);
 }
 
-/* Only called if symbol doesn't already exist */
-static navi_obj new_symbol(const char *str, unsigned long hashcode)
+/*
+ * Returns the interned symbol named by the @length bytes at @str, whose
+ * hash is @hash (see navi_symbol_hash).  @str needn't be NUL-terminated.
+ */
+navi_obj navi_intern(const char *str, size_t length, uint32_t hash)
 {
-	navi_obj object = navi_make_uninterned(str);
-	struct navi_symbol *symbol = navi_symbol(object);
-	NAVI_LIST_INSERT_HEAD(&symbol_table[hashcode % SYMTAB_SIZE], symbol, link);
-	return object;
+	size_t i = symtab_probe(str, length, hash);
+	if (symbol_table.slots[i])
+		return gc_keep_symbol(symbol_table.slots[i]);
+
+	navi_obj obj = make_symbol(str, length, hash);
+	if ((symbol_table.nr + 1) * 4 > (symbol_table.mask + 1) * 3) {
+		symtab_resize((symbol_table.mask + 1) * 2);
+		i = symtab_probe(str, length, hash);
+	}
+	navi_symbol(obj)->interned = true;
+	symbol_table.slots[i] = navi_symbol(obj);
+	symbol_table.nr++;
+	return obj;
 }
 
 navi_obj navi_make_symbol(const char *str)
 {
-	unsigned long hashcode = symbol_hash(str);
-	navi_obj symbol = symbol_lookup(str, hashcode);
-
-	return navi_is_void(symbol) ? new_symbol(str, hashcode) : symbol;
+	uint32_t hash = NAVI_SYMBOL_HASH_INIT;
+	size_t length;
+	for (length = 0; str[length]; length++)
+		hash = navi_symbol_hash_step(hash, str[length]);
+	return navi_intern(str, length, hash);
 }
 
 struct navi_binding *navi_make_binding(navi_obj symbol, navi_obj object)
@@ -342,6 +476,15 @@ void navi_scope_free(struct navi_scope *scope)
 	}
 	if (scope->next != NULL)
 		_navi_scope_unref(scope->next);
+	else
+		_navi_vm->env_version++;
+	if (scope->code)
+		navi_code_unref(scope->code);
+	if (navi_scope_is_frame(scope)) {
+		navi_free_frame(scope);
+		return;
+	}
+	free(scope->bindings);
 	free(scope);
 }
 
@@ -368,11 +511,27 @@ navi_obj navi_cstr_to_bytevec(const char *str)
 	return expr;
 }
 
+/*
+ * Small strings keep their data inline, after the string header.  The data
+ * moves to a separate buffer if the string outgrows it.
+ */
+#define INLINE_STRING_MAX (SMALL_OBJECT_MAX - sizeof(struct navi_object) \
+		- sizeof(struct navi_string) - 1)
+
 navi_obj navi_make_string(size_t capacity, size_t size, size_t length)
 {
-	navi_obj obj = make_object(NAVI_STRING, sizeof(struct navi_string));
-	struct navi_string *str = navi_string(obj);
-	str->data = navi_critical_malloc(capacity + 1);
+	navi_obj obj;
+	struct navi_string *str;
+	if (capacity <= INLINE_STRING_MAX) {
+		obj = make_object(NAVI_STRING,
+				sizeof(struct navi_string) + capacity + 1);
+		str = navi_string(obj);
+		str->data = str->buf;
+	} else {
+		obj = make_object(NAVI_STRING, sizeof(struct navi_string));
+		str = navi_string(obj);
+		str->data = navi_critical_malloc(capacity + 1);
+	}
 	str->data[capacity] = '\0';
 	str->data[size] = '\0';
 	str->capacity = capacity;
@@ -388,14 +547,21 @@ void navi_string_grow_storage(struct navi_string *str, long need)
 		return;
 	need -= free_space;
 	// TODO: align?
-	str->data = navi_critical_realloc(str->data, str->capacity + need + 1);
+	if (navi_string_is_inline(str)) {
+		unsigned char *data = navi_critical_malloc(str->capacity + need + 1);
+		memcpy(data, str->data, str->capacity + 1);
+		str->data = data;
+	} else {
+		str->data = navi_critical_realloc(str->data,
+				str->capacity + need + 1);
+	}
 	str->capacity += need;
 	str->data[str->capacity] = '\0';
 }
 
 navi_obj navi_make_empty_pair(void)
 {
-	return slab_make_object(pair_cache, NAVI_PAIR);
+	return slab_make_object(SIZE_PAIR, NAVI_PAIR);
 }
 
 navi_obj navi_make_pair(navi_obj car, navi_obj cdr)
@@ -466,24 +632,36 @@ navi_obj navi_make_procedure(navi_obj args, navi_obj body, navi_obj name, navi_e
 	proc->env = _navi_scope_ref(env.lexical);
 	proc->arity = count_pairs(args);
 	proc->flags = 0;
+	proc->c_argv = NULL;
 	proc->types = NULL;
+	proc->checks = 0;
+	proc->code = NULL;
 	if (!navi_is_proper_list(args))
 		proc->flags |= NAVI_PROC_VARIADIC;
 	return obj;
 }
 
-navi_obj navi_make_lambda(navi_obj args, navi_obj body, navi_env env)
+navi_obj navi_make_lambda_name(void)
 {
 	char buf[64];
-	static unsigned long count = 0;
-	snprintf(buf, 64, "lam%lu", count++);
+	snprintf(buf, 64, "lam%lu", _navi_vm->lambdas++);
 	buf[63] = '\0';
-	return navi_make_procedure(args, body, navi_make_uninterned(buf), env);
+	return navi_make_uninterned(buf);
+}
+
+navi_obj navi_make_lambda(navi_obj args, navi_obj body, navi_env env)
+{
+	return navi_make_procedure(args, body, navi_make_lambda_name(), env);
 }
 
 navi_obj navi_make_escape(void)
 {
-	return make_object(NAVI_ESCAPE, sizeof(struct navi_escape));
+	navi_obj obj = make_object(NAVI_ESCAPE, sizeof(struct navi_escape));
+	struct navi_escape *esc = navi_escape(obj);
+	esc->roots = gc_roots.nr;
+	esc->vm_sp = _navi_vm->bytecode.sp;
+	esc->vm_fp = _navi_vm->bytecode.fp;
+	return obj;
 }
 
 navi_obj navi_capture_env(navi_env env)
@@ -495,7 +673,7 @@ navi_obj navi_capture_env(navi_env env)
 
 navi_obj navi_make_thunk(navi_obj expr, navi_env env)
 {
-	navi_obj obj = slab_make_object(thunk_cache, NAVI_THUNK);
+	navi_obj obj = slab_make_object(SIZE_THUNK, NAVI_THUNK);
 	struct navi_thunk *thunk = navi_thunk(obj);
 	thunk->expr = expr;
 	thunk->env = env;
@@ -508,6 +686,11 @@ static navi_obj proc_from_spec(const struct navi_spec *spec, navi_env env)
 	navi_obj obj = make_object(spec->type, sizeof(struct navi_procedure));
 	struct navi_procedure *proc = navi_procedure(obj);
 	memcpy(proc, &spec->proc, sizeof(*proc));
+	proc->checks = 0;
+	for (unsigned i = 0; i < proc->arity; i++) {
+		if (proc->types[i] != NAVI_ANY)
+			proc->checks |= 1u << i;
+	}
 	proc->name = navi_make_symbol(spec->ident);
 	proc->args = navi_make_symbol("scm_args");
 	proc->env = _navi_scope_ref(env.lexical);
@@ -709,51 +892,192 @@ DEFUN(equalp, "equal?", 2, 0, NAVI_ANY, NAVI_ANY)
 	return navi_make_bool(navi_equalp(scm_arg1, scm_arg2));
 }
 
-__hot struct navi_guard *navi_gc_guard(navi_obj obj, navi_env env)
+void _navi_gc_grow_roots(void)
 {
-	if (navi_is_immediate(obj))
-		return NULL;
-
-	struct navi_guard *guard = navi_slab_alloc(guard_cache);
-	guard->obj = obj;
-	NAVI_LIST_INSERT_HEAD(&env.lexical->guards, guard, link);
-	return guard;
+	gc_roots.size = gc_roots.size ? gc_roots.size * 2 : 256;
+	gc_roots.objects = navi_critical_realloc(gc_roots.objects,
+			sizeof(navi_obj) * gc_roots.size);
 }
 
-__hot void navi_gc_unguard(struct navi_guard *guard)
+static inline bool gc_is_protected(struct navi_object *obj)
 {
-	if (guard) {
-		NAVI_LIST_REMOVE(guard, link);
-		navi_slab_free(guard_cache, guard);
-	}
+	return obj->flags & NAVI_GC_PROTECT;
 }
 
-static inline bool gc_is_protected(struct navi_object *obj)
+/*
+ * Objects allocated from slabs have their mark bits in the slab's mark
+ * bitmap.  Other objects are marked in their flags.
+ */
+static inline bool gc_in_slab(struct navi_object *obj)
 {
-	return obj->flags & NAVI_GC_PROTECT;
+	return obj->size_class != SIZE_MALLOC;
 }
 
 static inline bool gc_is_marked(struct navi_object *obj)
 {
+	if (gc_in_slab(obj))
+		return navi_slab_is_marked(obj);
 	return obj->flags & NAVI_GC_MARK;
 }
 
+static inline bool gc_is_old(struct navi_object *obj)
+{
+	return obj->flags & NAVI_GC_OLD;
+}
+
 static inline void gc_set_mark(navi_obj obj)
 {
-	obj.p->flags |= NAVI_GC_MARK;
+	if (gc_in_slab(obj.p))
+		navi_slab_set_mark(obj.p);
+	else
+		obj.p->flags |= NAVI_GC_MARK;
 }
 
 static inline void gc_clear_mark(struct navi_object *obj)
 {
-	obj->flags &= ~NAVI_GC_MARK;
+	if (gc_in_slab(obj))
+		navi_slab_clear_mark(obj);
+	else
+		obj->flags &= ~NAVI_GC_MARK;
 }
+
+/*
+ * Major collections are incremental.  A cycle marks the old generation in
+ * slices, interleaved with the mutator, and then sweeps it in slices.  Each
+ * slice runs from navi_gc_check and stops when the time budget is used up.
+ *
+ * Marking is tri-color: white objects are unmarked, gray objects are marked
+ * and on the gray stack, and black objects are marked and have been scanned.
+ * Stores into heap objects go through navi_gc_write_barrier, which shades
+ * the stored object gray, so a black object never points to a white one.
+ * Roots are not covered by the barrier, so they are scanned again when the
+ * gray stack runs dry, together with a minor collection; this final step is
+ * not incremental.
+ *
+ * The major cycle only marks old objects: the nursery is handled by minor
+ * collections, which keep running during the cycle.  Objects promoted while
+ * marking are shaded, and old objects reached from the nursery are shaded
+ * as a minor collection passes them.
+ */
+enum {
+	GC_IDLE,
+	GC_MARK,
+	GC_SWEEP,
+};
+
+/* allocation between two slices of a major cycle */
+#define GC_SLICE_BYTES (32 * 1024)
+
+/* time budget for one slice (microseconds); 0 means no limit */
+#define GC_DEFAULT_BUDGET 1000
+
+/* empty slabs kept by each slab cache at the end of a major cycle */
+#define GC_DEFAULT_RETENTION 8
+
+/* a major collection's work is counted in references; check the clock every.. */
+#define GC_CLOCK_INTERVAL 256
+
+/*
+ * Marking uses explicit stacks rather than recursion.  Old objects are
+ * shaded onto the gray stack, which a major cycle drains a slice at a time;
+ * young objects are pushed onto the mark stack, which a minor collection
+ * drains before it returns.
+ *
+ * Sweeping keeps its position: the next slab of each size class, and the
+ * next entry in the large-object registry.  Entries before sweep.kept are
+ * live; entries from sweep.end on were added after sweeping started.
+ */
+
+static uint64_t gc_now(void)
+{
+	struct timespec t;
+#ifdef HAVE_CLOCK_GETTIME
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	t.tv_sec = tv.tv_sec;
+	t.tv_nsec = tv.tv_usec * 1000;
+#endif
+	return (uint64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static inline void gc_push(struct navi_gc_stack *stack, navi_obj obj)
+{
+	if (unlikely(stack->nr == stack->size)) {
+		stack->size = stack->size ? stack->size * 2 : 256;
+		stack->objects = navi_critical_realloc(stack->objects,
+				sizeof(navi_obj) * stack->size);
+	}
+	stack->objects[stack->nr++] = obj;
+}
+
+/* Pop an object, and prefetch the header of the one below it. */
+static inline navi_obj gc_pop(struct navi_gc_stack *stack)
+{
+	navi_obj obj = stack->objects[--stack->nr];
+	if (stack->nr)
+		prefetch(stack->objects[stack->nr - 1].p);
+	return obj;
+}
+
+static void gc_shade(navi_obj obj)
+{
+	if (gc_is_marked(obj.p))
+		return;
+	gc_set_mark(obj);
+	gc_push(&gray, obj);
+}
+
+void _navi_gc_shade(navi_obj obj)
+{
+	gc_shade(obj);
+}
+
+/*
+ * Old objects are shaded if a major cycle is marking.  Young objects are
+ * only traced by minor collections.
+ */
 static __hot void gc_mark_obj(navi_obj obj)
+{
+	if (!navi_ptr_type(obj))
+		return;
+	if (gc_is_old(obj.p)) {
+		if (_navi_gc_marking)
+			gc_shade(obj);
+		return;
+	}
+	if (!gc_minor || gc_is_marked(obj.p))
+		return;
+	gc_set_mark(obj);
+	gc_push(&mark_stack, obj);
+}
+
+/*
+ * Mark the cdr of a pair.  Returns true if it's an unmarked pair in the
+ * generation being traced, in which case the caller scans it in place.
+ */
+static inline bool gc_mark_cdr(navi_obj cdr, bool minor)
+{
+	if (navi_ptr_type(cdr) && cdr.p->type == NAVI_PAIR
+			&& !gc_is_marked(cdr.p) && gc_is_old(cdr.p) != minor) {
+		gc_set_mark(cdr);
+		return true;
+	}
+	gc_mark_obj(cdr);
+	return false;
+}
+
+/* the most pairs of a list scanned at once */
+#define GC_LIST_CHUNK 256
+
+/* Mark the objects referenced by @obj; returns the number of references. */
+static __hot size_t gc_mark_children(navi_obj obj)
 {
 	struct navi_vector *vec;
 	struct navi_procedure *proc;
+	size_t work = 0;
 
-	if (!navi_ptr_type(obj))
-		return;
 	switch (navi_type(obj)) {
 	case NAVI_VOID:
 	case NAVI_NIL:
@@ -763,125 +1087,539 @@ static __hot void gc_mark_obj(navi_obj obj)
 	case NAVI_CHAR:
 		break;
 	case NAVI_PAIR:
-	case NAVI_BOUNCE:
 	case NAVI_PARAMETER:
-		gc_set_mark(obj);
-		gc_mark_obj(navi_car(obj));
-		gc_mark_obj(navi_cdr(obj));
+		/* walk down the list, rather than pushing each pair */
+		for (bool minor = gc_minor;;) {
+			navi_obj cdr = navi_cdr(obj);
+			if (navi_ptr_type(cdr))
+				prefetch(cdr.p);
+			gc_mark_obj(navi_car(obj));
+			if (!gc_mark_cdr(cdr, minor))
+				break;
+			obj = cdr;
+			/* bound the work, so a major slice can check the clock */
+			if (++work == GC_LIST_CHUNK) {
+				gc_push(minor ? &mark_stack : &gray, obj);
+				break;
+			}
+		}
+		work++;
 		break;
 	case NAVI_PORT:
-		gc_set_mark(obj);
 		gc_mark_obj(navi_port(obj)->expr);
+		work = 1;
 		break;
 	case NAVI_SYMBOL:
 	case NAVI_STRING:
 	case NAVI_BYTEVEC:
-		gc_set_mark(obj);
 		break;
 	case NAVI_VECTOR:
 	case NAVI_VALUES:
 	case NAVI_CASELAMBDA:
-		gc_set_mark(obj);
 		vec = navi_vector(obj);
 		for (size_t i = 0; i < vec->size; i++)
 			gc_mark_obj(vec->data[i]);
+		work = vec->size;
 		break;
 	case NAVI_THUNK:
-		gc_set_mark(obj);
 		gc_mark_obj(navi_thunk(obj)->expr);
+		work = 1;
 		break;
 	case NAVI_MACRO:
 	case NAVI_SPECIAL:
 	case NAVI_PROMISE:
 	case NAVI_PROCEDURE:
-		gc_set_mark(obj);
 		proc = navi_procedure(obj);
 		gc_mark_obj(proc->args);
-		gc_set_mark(proc->name);
+		gc_mark_obj(proc->name);
 		if (!navi_proc_is_builtin(proc))
 			gc_mark_obj(proc->body);
+		work = 3;
 		break;
 	case NAVI_ESCAPE:
-		gc_set_mark(obj);
 		gc_mark_obj(navi_escape(obj)->arg);
+		work = 1;
 		break;
 	case NAVI_ENVIRONMENT:
-		gc_set_mark(obj);
+	case NAVI_BOUNCE:
 		break;
 	case NAVI_TRAP:
 		navi_die("trap!");
 	}
+	return work;
 }
 
 static void gc_mark_env(struct navi_scope *env)
 {
 	struct navi_binding *binding;
+	for (unsigned i = 0; i < env->nr_slots; i++) {
+		gc_mark_obj(env->names[i]);
+		gc_mark_obj(env->slots[i]);
+	}
 	navi_scope_for_each(binding, env) {
-		gc_set_mark(binding->symbol);
+		gc_mark_obj(binding->symbol);
 		gc_mark_obj(binding->object);
 	}
-	struct navi_guard *guard;
-	NAVI_LIST_FOREACH(guard, &env->guards, link) {
-		gc_mark_obj(guard->obj);
-	}
 }
 
-static void gc_mark(void)
+static void gc_mark_roots(void)
 {
 	struct navi_scope *scope;
-	NAVI_LIST_FOREACH(scope, &active_environments, link) {
+	NAVI_LIST_FOREACH(scope, &_navi_vm->environments, link) {
 		gc_mark_env(scope);
 	}
+	for (size_t i = 0; i < gc_roots.nr; i++)
+		gc_mark_obj(gc_roots.objects[i]);
+	gc_mark_obj(_navi_vm->bounce.expr);
+	navi_library_mark(gc_mark_obj);
+	navi_builtins_mark(gc_mark_obj);
+	navi_vm_mark(gc_mark_obj);
+}
+
+void _navi_gc_remember(struct navi_object *obj)
+{
+	obj->flags |= NAVI_GC_REMEMBERED;
+	object_list_push(&remembered, obj);
+}
+
+/* After a minor collection the nursery is empty, so nothing needs remembering. */
+static void gc_forget(void)
+{
+	for (size_t i = 0; i < remembered.nr; i++)
+		remembered.objects[i]->flags &= ~NAVI_GC_REMEMBERED;
+	remembered.nr = 0;
+}
+
+/*
+ * Promote a surviving young object.  While a major cycle is marking,
+ * promoted objects are shaded.  While it's sweeping, promoted pairs and
+ * thunks stay marked so that the sweep leaves them alone (other objects are
+ * added to the registry after the part being swept).
+ */
+static void gc_promote(struct navi_object *obj)
+{
+	obj->flags |= NAVI_GC_OLD;
+	if (!gc_in_slab(obj)) {
+		gc_clear_mark(obj);
+		object_list_push(&large, obj);
+	} else if (gc_phase == GC_SWEEP) {
+		gc_set_mark(to_obj(obj));
+	} else {
+		gc_clear_mark(obj);
+	}
+	if (_navi_gc_marking)
+		gc_shade(to_obj(obj));
+}
+
+static inline bool gc_survives(struct navi_object *obj)
+{
+	return gc_is_marked(obj) || gc_is_protected(obj);
+}
+
+/*
+ * Called when interning finds @symbol in the table.  While a major cycle is
+ * sweeping, an unmarked old symbol is dead but not yet swept; it's marked so
+ * that the sweep leaves it to its new reference.
+ */
+static navi_obj gc_keep_symbol(struct navi_symbol *symbol)
+{
+	struct navi_object *obj = navi_object(symbol);
+	if (gc_phase == GC_SWEEP && gc_is_old(obj))
+		gc_set_mark(to_obj(obj));
+	return to_obj(obj);
+}
+
+/* Called by navi_slab_sweep_fresh: frees dead young objects. */
+static bool gc_sweep_young(void *mem)
+{
+	struct navi_object *obj = mem;
+	if (gc_is_old(obj))
+		return false;
+	if (gc_survives(obj)) {
+		gc_promote(obj);
+		return false;
+	}
+	navi_finalize(obj);
+	return true;
 }
 
-static void gc_sweep(void)
+/* Free the dead objects in the nursery, and promote the survivors. */
+static void gc_sweep_nursery(void)
 {
-	struct navi_object *obj, *last, *p;
-	last = heap.slh_first;
-	NAVI_SLIST_FOREACH_SAFE(obj, &heap, link, p) {
-		if (gc_is_marked(obj)) {
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		navi_slab_sweep_fresh(object_caches[i], gc_sweep_young);
+	for (size_t i = 0; i < nursery.nr; i++) {
+		if (gc_survives(nursery.objects[i]))
+			gc_promote(nursery.objects[i]);
+		else
+			navi_free(nursery.objects[i]);
+	}
+	nursery.nr = 0;
+	stats.nursery_bytes = 0;
+}
+
+static void do_gc_collect_minor(void)
+{
+	gc_minor = true;
+	gc_mark_roots();
+	/* old objects in the remembered set are roots */
+	for (size_t i = 0; i < remembered.nr; i++)
+		gc_mark_children(to_obj(remembered.objects[i]));
+	while (mark_stack.nr)
+		gc_mark_children(gc_pop(&mark_stack));
+	gc_forget();
+	gc_sweep_nursery();
+	gc_minor = false;
+	stats.minor_collections++;
+}
+
+static void gc_start_cycle(void)
+{
+	gc_phase = GC_MARK;
+	_navi_gc_marking = true;
+	gc_mark_roots();
+}
+
+/* Scan gray objects until the stack is empty or @deadline has passed. */
+static bool gc_mark_slice(uint64_t deadline)
+{
+	size_t work = 0;
+	while (gray.nr) {
+		work += gc_mark_children(gc_pop(&gray));
+		if (deadline && work >= GC_CLOCK_INTERVAL) {
+			if (gc_now() >= deadline)
+				return false;
+			work = 0;
+		}
+	}
+	return true;
+}
+
+/* Rescan the roots and finish marking, then start sweeping. */
+static void gc_finish_mark(void)
+{
+	do_gc_collect_minor();
+	gc_mark_slice(0);
+	_navi_gc_marking = false;
+
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		sweep.slabs[i] = object_caches[i]->slabs;
+	sweep.next = sweep.kept = 0;
+	sweep.end = large.nr;
+	gc_phase = GC_SWEEP;
+}
+
+/* Called by navi_slab_sweep for unmarked objects: frees the dead old ones. */
+static bool gc_sweep_dead(void *mem)
+{
+	struct navi_object *obj = mem;
+	if (!gc_is_old(obj) || gc_survives(obj))
+		return false;
+	navi_finalize(obj);
+	return true;
+}
+
+static bool gc_sweep_slabs(struct slab_cache *cache, struct slab **next,
+		uint64_t deadline)
+{
+	while (*next) {
+		navi_slab_sweep(cache, *next, gc_sweep_dead);
+		*next = (*next)->next;
+		if (deadline && gc_now() >= deadline)
+			return false;
+	}
+	return true;
+}
+
+static bool gc_sweep_large(uint64_t deadline)
+{
+	for (unsigned n = 1; sweep.next < sweep.end; n++) {
+		struct navi_object *obj = large.objects[sweep.next++];
+		if (gc_survives(obj)) {
 			gc_clear_mark(obj);
-			last = obj;
-		} else if (unlikely(gc_is_protected(obj))) {
-			last = obj;
-		} else if (obj->type == NAVI_SYMBOL) {
-			last = obj;
+			large.objects[sweep.kept++] = obj;
 		} else {
-			if (unlikely(obj == NAVI_SLIST_FIRST(&heap)))
-				NAVI_SLIST_REMOVE_HEAD(&heap, link);
-			else
-				NAVI_SLIST_REMOVE_AFTER(last, link);
 			navi_free(obj);
 		}
+		if (deadline && !(n % GC_CLOCK_INTERVAL) && gc_now() >= deadline)
+			return false;
 	}
+	// close the gap left by the dead objects
+	memmove(&large.objects[sweep.kept], &large.objects[sweep.end],
+			(large.nr - sweep.end) * sizeof(struct navi_object*));
+	large.nr -= sweep.end - sweep.kept;
+	sweep.next = sweep.kept = sweep.end = 0;
+	return true;
 }
 
-unsigned int _navi_gc_disabled = 0;
+/* Sweep until every old object has been visited or @deadline has passed. */
+static bool gc_sweep_slice(uint64_t deadline)
+{
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++) {
+		if (!gc_sweep_slabs(object_caches[i], &sweep.slabs[i], deadline))
+			return false;
+	}
+	return gc_sweep_large(deadline);
+}
 
-static void do_gc_collect(void)
+static void gc_shrink_cache(struct slab_cache *cache)
 {
-	gc_mark();
-	gc_sweep();
-	gc_stats.threshold = gc_stats.bytes * 4;
+	stats.released_bytes += (size_t) SLAB_SIZE
+		* navi_slab_shrink(cache, gc_retention);
 }
 
-void navi_gc_collect(void)
+/* Give empty slabs beyond the retention limit back to the OS. */
+static void gc_release_slabs(void)
+{
+	navi_slab_flush();
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		gc_shrink_cache(object_caches[i]);
+	gc_shrink_cache(binding_cache);
+}
+
+static size_t gc_retained_bytes(void)
+{
+	size_t slabs = binding_cache->nr_empty;
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		slabs += object_caches[i]->nr_empty;
+	return slabs * SLAB_SIZE;
+}
+
+static void gc_finish_cycle(void)
+{
+	size_t old_bytes = stats.bytes - stats.nursery_bytes;
+	stats.threshold = old_bytes * 4 > NURSERY_SIZE ? old_bytes * 4
+		: NURSERY_SIZE;
+	stats.major_collections++;
+	gc_phase = GC_IDLE;
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		navi_slab_clear_marks(object_caches[i]);
+	gc_release_slabs();
+	symtab_shrink();
+}
+
+/* Do one slice of the current major cycle. */
+static void gc_step(uint64_t deadline)
 {
-	if (!_navi_gc_disabled) {
-		do_gc_collect();
+	if (gc_phase == GC_MARK) {
+		if (!gc_mark_slice(deadline))
+			return;
+		gc_finish_mark();
+		if (deadline && gc_now() >= deadline)
+			return;
 	}
+	if (gc_phase == GC_SWEEP && gc_sweep_slice(deadline))
+		gc_finish_cycle();
+}
+
+static void gc_schedule(void)
+{
+	gc_next_check = NURSERY_SIZE;
+	if (gc_phase != GC_IDLE && stats.nursery_bytes + GC_SLICE_BYTES
+			< NURSERY_SIZE)
+		gc_next_check = stats.nursery_bytes + GC_SLICE_BYTES;
 }
 
-void navi_gc_check(void)
+static void gc_record_pause(uint64_t start)
 {
-	// if threshold unset, trigger first collection
-	if (unlikely(!gc_stats.threshold))
-		gc_stats.threshold = gc_stats.bytes - 1;
-	if (likely(gc_stats.bytes < gc_stats.threshold))
+	uint64_t pause = gc_now() - start;
+	stats.pauses++;
+	stats.pause_total += pause;
+	if (pause > stats.pause_max)
+		stats.pause_max = pause;
+}
+
+void navi_gc_collect(void)
+{
+	if (_navi_gc_disabled)
 		return;
+
+	uint64_t start = gc_now();
+	// finish the current cycle, then do a complete one
+	while (gc_phase != GC_IDLE)
+		gc_step(0);
+	gc_start_cycle();
+	while (gc_phase != GC_IDLE)
+		gc_step(0);
+	gc_schedule();
+	gc_record_pause(start);
+}
+
+/* Set the time budget for a slice of a major collection; returns the old one. */
+unsigned long navi_gc_set_budget(unsigned long usec)
+{
+	unsigned long old = gc_budget;
+	gc_budget = usec;
+	return old;
+}
+
+/*
+ * Set the number of empty slabs each slab cache keeps when a major cycle
+ * finishes; the rest are given back to the OS.  Returns the old number.
+ */
+unsigned long navi_gc_set_retention(unsigned long slabs)
+{
+	unsigned long old = gc_retention;
+	gc_retention = slabs;
+	return old;
+}
+
+/*
+ * Collect the nursery if it's full, and start a major cycle if the old
+ * generation has grown past the threshold.  While a major cycle is running,
+ * do a slice of it every GC_SLICE_BYTES of allocation.
+ */
+void _navi_gc_check(void)
+{
 	if (unlikely(_navi_gc_disabled))
 		return;
-	do_gc_collect();
+
+	uint64_t start = gc_now();
+	if (stats.nursery_bytes >= NURSERY_SIZE) {
+		do_gc_collect_minor();
+		if (gc_phase == GC_IDLE && stats.bytes >= stats.threshold)
+			gc_start_cycle();
+	}
+	if (gc_phase != GC_IDLE)
+		gc_step(gc_budget ? start + gc_budget : 0);
+	gc_schedule();
+	gc_record_pause(start);
+}
+
+static void finalize_object(void *mem, void *data)
+{
+	(void) data;
+	navi_finalize(mem);
+}
+
+/* Free every object in the current VM's heap, and the heap itself. */
+static void heap_free(void)
+{
+	// a sweep in progress leaves stale entries in the registry
+	while (gc_phase != GC_IDLE)
+		gc_step(0);
+	// let the objects go in any order: unintern the symbols first
+	for (size_t i = 0; i <= symbol_table.mask; i++) {
+		if (symbol_table.slots[i])
+			symbol_table.slots[i]->interned = false;
+	}
+	free(symbol_table.slots);
+	symbol_table.slots = NULL;
+	symbol_table.nr = 0;
+	for (size_t i = 0; i < nursery.nr; i++)
+		navi_free(nursery.objects[i]);
+	for (size_t i = 0; i < large.nr; i++)
+		navi_free(large.objects[i]);
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		navi_slab_for_each(object_caches[i], finalize_object, NULL);
+
+	navi_env_free_all();
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		navi_slab_cache_destroy(object_caches[i]);
+	navi_slab_cache_destroy(binding_cache);
+	free(nursery.objects);
+	free(large.objects);
+	free(remembered.objects);
+	free(gray.objects);
+	free(mark_stack.objects);
+	free(gc_roots.objects);
+}
+
+/*
+ * Create a VM.  The new VM is set up on the calling thread, which is left
+ * with the VM it had before (if any); call navi_vm_enter to run it.
+ */
+struct navi_vm *navi_vm_create(void)
+{
+	struct navi_vm *current = _navi_vm;
+	struct navi_vm *vm = navi_critical_malloc(sizeof(struct navi_vm));
+	memset(vm, 0, sizeof(struct navi_vm));
+	vm->engine = NAVI_ENGINE_CLOSURE;
+	vm->heap.budget = GC_DEFAULT_BUDGET;
+	vm->heap.retention = GC_DEFAULT_RETENTION;
+	vm->heap.next_check = NURSERY_SIZE;
+
+	navi_vm_enter(vm);
+	navi_env_init();
+	heap_init();
+	navi_internal_init();
+	navi_vm_leave();
+	if (current)
+		navi_vm_enter(current);
+	return vm;
+}
+
+/*
+ * Destroy @vm, freeing everything it holds.  No thread may be running it,
+ * except the calling one.
+ */
+void navi_vm_destroy(struct navi_vm *vm)
+{
+	struct navi_vm *current = _navi_vm;
+	navi_vm_enter(vm);
+	heap_free();
+	free(vm->bytecode.stack);
+	free(vm->bytecode.frames);
+	free(vm->builtins);
+	free(vm);
+	_navi_vm = NULL;
+	if (current && current != vm)
+		navi_vm_enter(current);
+}
+
+/*
+ * Make @vm the calling thread's current VM: the one which all other calls
+ * on this thread operate on.  A VM must not be current on two threads at
+ * the same time.
+ */
+void navi_vm_enter(struct navi_vm *vm)
+{
+	if (_navi_vm && _navi_vm != vm)
+		navi_vm_leave();
+	_navi_vm = vm;
+}
+
+/*
+ * Leave the current VM, so that another thread may enter it.  Threads must
+ * leave their VM before they exit.
+ */
+void navi_vm_leave(void)
+{
+	navi_slab_flush();
+	_navi_vm = NULL;
+}
+
+/* Create a VM and enter it. */
+void navi_init(void)
+{
+	navi_vm_enter(navi_vm_create());
+}
+
+DEFUN(gc_set_budget, "gc-set-budget!", 1, 0, NAVI_FIXNUM)
+{
+	if (navi_fixnum(scm_arg1) < 0)
+		navi_error(scm_env, "negative GC budget");
+	navi_gc_set_budget(navi_fixnum(scm_arg1));
+	return navi_unspecified();
+}
+
+DEFUN(gc_set_retention, "gc-set-retention!", 1, 0, NAVI_FIXNUM)
+{
+	if (navi_fixnum(scm_arg1) < 0)
+		navi_error(scm_env, "negative slab retention");
+	navi_gc_set_retention(navi_fixnum(scm_arg1));
+	return navi_unspecified();
+}
+
+/* Set the arena size for the pair and thunk caches (see slab.c). */
+DEFUN(gc_set_slab_arena, "gc-set-slab-arena!", 1, 0, NAVI_FIXNUM)
+{
+	long size = navi_fixnum(scm_arg1);
+	if (size <= 0)
+		navi_error(scm_env, "invalid slab arena size");
+	navi_slab_set_arena_size(object_caches[SIZE_PAIR], size);
+	navi_slab_set_arena_size(object_caches[SIZE_THUNK], size);
+	return navi_unspecified();
 }
 
 DEFUN(gc_collect, "gc-collect", 0, 0)
@@ -890,33 +1628,69 @@ DEFUN(gc_collect, "gc-collect", 0, 0)
 	return navi_unspecified();
 }
 
+static void print_object(void *mem, void *env)
+{
+	struct navi_object *obj = mem;
+	if (navi_is_builtin(to_obj(obj)))
+		return;
+	printf("<%p> ", mem);
+	navi_write(to_obj(obj), *(navi_env*)env);
+	putchar('\n');
+}
+
 DEFUN(gc_count, "gc-count", 0, 0)
 {
-	struct navi_object *expr;
-	NAVI_SLIST_FOREACH(expr, &heap, link) {
-		if (navi_is_builtin(to_obj(expr)))
-			continue;
-		printf("<%p> ", (void*)expr);
-		navi_write(to_obj(expr), scm_env);
-		putchar('\n');
+	for (size_t i = 0; i < nursery.nr; i++)
+		print_object(nursery.objects[i], &scm_env);
+	for (size_t i = 0; i < large.nr; i++) {
+		// skip the entries that a sweep in progress has already moved
+		if (i == sweep.kept && sweep.next)
+			i = sweep.next;
+		if (i < large.nr)
+			print_object(large.objects[i], &scm_env);
 	}
+	for (unsigned i = 1; i < NR_SIZE_CLASSES; i++)
+		navi_slab_for_each(object_caches[i], print_object, &scm_env);
 	return navi_unspecified();
 }
 
 DEFUN(gc_stats, "gc-stats", 0, 0)
 {
-	char buf[128];
+	char buf[1024];
 	struct navi_port *p = navi_port(navi_current_output_port(scm_env));
-	snprintf(buf, 127,
+	snprintf(buf, 1023,
 			"  Bytes allocated: %lu\n"
 			"(without headers): %lu\n"
 			"Objects allocated: %lu\n"
-			"        Threshold: %lu\n",
-			gc_stats.bytes,
-			gc_stats.bytes - gc_stats.objects*sizeof(struct navi_object),
-			gc_stats.objects,
-			gc_stats.threshold);
-	buf[127] = '\0';
+			"        Threshold: %lu\n"
+			"    Nursery bytes: %lu\n"
+			"Minor collections: %lu\n"
+			"Major collections: %lu\n"
+			"   Budget (usecs): %lu\n"
+			"           Pauses: %lu\n"
+			"Max pause (usecs): %lu\n"
+			"Avg pause (usecs): %lu\n"
+			"   Retained bytes: %lu\n"
+			"   Released bytes: %lu\n"
+			" Interned symbols: %lu\n"
+			"Symbol table size: %lu\n",
+			stats.bytes,
+			stats.bytes - stats.objects*sizeof(struct navi_object),
+			stats.objects,
+			stats.threshold,
+			stats.nursery_bytes,
+			stats.minor_collections,
+			stats.major_collections,
+			gc_budget,
+			stats.pauses,
+			(unsigned long) stats.pause_max,
+			stats.pauses ? (unsigned long) (stats.pause_total
+				/ stats.pauses) : 0,
+			gc_retained_bytes(),
+			stats.released_bytes,
+			symbol_table.nr,
+			symbol_table.mask + 1);
+	buf[1023] = '\0';
 	navi_port_write_cstr(buf, p, scm_env);
 	return navi_unspecified();
 }
@@ -0,0 +1,775 @@
+/* Copyright 2014-2015 Drew Thoreson
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * image.c: heap images and the library cache
+ *
+ * A heap image holds every loaded library of a VM: its name, its exports and
+ * the objects bound in its environment.  Loading an image registers those
+ * libraries as already loaded, so that importing them doesn't read or
+ * evaluate any source.
+ *
+ * The image is a flat stream of tagged objects.  Every heap object is given
+ * an index the first time it is written; later occurrences are written as a
+ * reference to that index, which preserves sharing (e.g. a procedure bound
+ * in several libraries) and allows cyclic data.  Immediate objects are
+ * written as their raw bits.  Builtins are written as their index in the
+ * builtin table and lambdas as their source, with the library whose
+ * environment they close over; they are compiled again when first called.
+ *
+ * Scopes, compiled code and ports live outside the heap, so the image isn't
+ * mapped in place: it is mapped read-only and the objects are rebuilt from
+ * it.  Images are only valid for a binary with the same builtin table, which
+ * is checked with a hash of the builtin names.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMAGE_MAGIC "NAVIIMG"
+#define IMAGE_VERSION 1
+
+struct image_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_builtins;
+	uint64_t builtins_hash;
+	uint32_t nr_libraries;
+};
+
+enum {
+	IMAGE_IMMEDIATE,
+	IMAGE_REF,
+	IMAGE_SYMBOL,
+	IMAGE_UNINTERNED,
+	IMAGE_STRING,
+	IMAGE_BYTEVEC,
+	IMAGE_VECTOR,
+	IMAGE_PAIR,
+	IMAGE_BUILTIN,
+	IMAGE_LAMBDA,
+};
+
+static void image_stamp(struct image_header *header)
+{
+	const char *name;
+	uint64_t hash = 14695981039346656037ULL;
+	unsigned i;
+	for (i = 0; (name = navi_builtin_name(i)); i++) {
+		for (; *name; name++)
+			hash = (hash ^ (unsigned char) *name) * 1099511628211ULL;
+		hash = (hash ^ 0xff) * 1099511628211ULL;
+	}
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+	header->version = IMAGE_VERSION;
+	header->nr_builtins = i;
+	header->builtins_hash = hash;
+}
+
+static struct navi_library **loaded_libraries(unsigned *nr)
+{
+	struct navi_library *lib, **libs = NULL;
+	*nr = 0;
+	for (int i = 0; i < NAVI_ENV_HT_SIZE; i++) {
+		NAVI_LIST_FOREACH(lib, &_navi_vm->libraries[i], link) {
+			if (!lib->loaded)
+				continue;
+			libs = navi_critical_realloc(libs,
+					(*nr + 1) * sizeof(*libs));
+			libs[(*nr)++] = lib;
+		}
+	}
+	return libs;
+}
+
+/* Writing {{{ */
+struct image_writer {
+	unsigned char *buf;
+	size_t size;
+	size_t capacity;
+	/* object -> index, open addressing */
+	struct navi_object **keys;
+	uint32_t *ids;
+	size_t mask;
+	uint32_t nr_objects;
+	struct navi_library **libs;
+	unsigned nr_libs;
+	navi_env env;
+	/* where to go on unsaveable objects, instead of raising an error */
+	jmp_buf *error;
+};
+
+static void writer_init(struct image_writer *w, navi_env env)
+{
+	memset(w, 0, sizeof(*w));
+	w->mask = 255;
+	w->keys = navi_critical_malloc(256 * sizeof(*w->keys));
+	w->ids = navi_critical_malloc(256 * sizeof(*w->ids));
+	memset(w->keys, 0, 256 * sizeof(*w->keys));
+	w->env = env;
+}
+
+static void writer_free(struct image_writer *w)
+{
+	free(w->buf);
+	free(w->keys);
+	free(w->ids);
+	free(w->libs);
+}
+
+/*
+ * Write the buffer of @w to @path.  The data is written to a temporary file
+ * and renamed into place, so that processes reading the file concurrently
+ * see either the old or the new contents.
+ */
+static int writer_commit(struct image_writer *w, const char *path)
+{
+	size_t len = strlen(path);
+	char *tmp = navi_critical_malloc(len + 32);
+	snprintf(tmp, len + 32, "%s.%ld.tmp", path, (long) getpid());
+	FILE *file = fopen(tmp, "wb");
+	int ok = file && fwrite(w->buf, 1, w->size, file) == w->size;
+	if (file && fclose(file))
+		ok = 0;
+	if (ok && rename(tmp, path))
+		ok = 0;
+	if (!ok)
+		unlink(tmp);
+	free(tmp);
+	return ok;
+}
+
+static void put_bytes(struct image_writer *w, const void *data, size_t size)
+{
+	if (w->size + size > w->capacity) {
+		while (w->size + size > w->capacity)
+			w->capacity = w->capacity ? w->capacity * 2 : 4096;
+		w->buf = navi_critical_realloc(w->buf, w->capacity);
+	}
+	memcpy(w->buf + w->size, data, size);
+	w->size += size;
+}
+
+static void put_u8(struct image_writer *w, uint8_t v)
+{
+	put_bytes(w, &v, 1);
+}
+
+static void put_u32(struct image_writer *w, uint32_t v)
+{
+	put_bytes(w, &v, sizeof(v));
+}
+
+static size_t object_slot(struct image_writer *w, struct navi_object *obj)
+{
+	size_t i = ((uintptr_t) obj >> 4) & w->mask;
+	while (w->keys[i] && w->keys[i] != obj)
+		i = (i + 1) & w->mask;
+	return i;
+}
+
+static void record_object(struct image_writer *w, struct navi_object *obj)
+{
+	if (w->nr_objects >= (w->mask + 1) / 2) {
+		struct navi_object **keys = w->keys;
+		uint32_t *ids = w->ids;
+		size_t old_size = w->mask + 1;
+		w->mask = old_size * 2 - 1;
+		w->keys = navi_critical_malloc(old_size * 2 * sizeof(*keys));
+		w->ids = navi_critical_malloc(old_size * 2 * sizeof(*ids));
+		memset(w->keys, 0, old_size * 2 * sizeof(*keys));
+		for (size_t i = 0; i < old_size; i++) {
+			if (!keys[i])
+				continue;
+			size_t slot = object_slot(w, keys[i]);
+			w->keys[slot] = keys[i];
+			w->ids[slot] = ids[i];
+		}
+		free(keys);
+		free(ids);
+	}
+	size_t slot = object_slot(w, obj);
+	w->keys[slot] = obj;
+	w->ids[slot] = w->nr_objects++;
+}
+
+static int library_index(struct image_writer *w, struct navi_scope *scope)
+{
+	for (unsigned i = 0; i < w->nr_libs; i++) {
+		if (w->libs[i]->env.lexical == scope)
+			return i;
+	}
+	return -1;
+}
+
+static _Noreturn void unsaveable(struct image_writer *w, navi_obj obj)
+{
+	if (w->error)
+		longjmp(*w->error, 1);
+	navi_error(w->env, "object cannot be saved in a heap image",
+			navi_make_apair("object", obj));
+}
+
+static void put_object(struct image_writer *w, navi_obj obj);
+
+static void put_lambda(struct image_writer *w, navi_obj obj)
+{
+	struct navi_procedure *proc = navi_procedure(obj);
+	int lib = library_index(w, proc->env);
+	if (lib < 0)
+		unsaveable(w, obj);
+	put_u8(w, IMAGE_LAMBDA);
+	put_u8(w, navi_type(obj));
+	put_u32(w, lib);
+	put_object(w, proc->name);
+	put_object(w, proc->args);
+	put_object(w, proc->body);
+	record_object(w, obj.p);
+}
+
+static void put_object(struct image_writer *w, navi_obj obj)
+{
+	int i;
+	size_t slot;
+	for (;;) {
+		if (!navi_ptr_type(obj)) {
+			put_u8(w, IMAGE_IMMEDIATE);
+			put_bytes(w, &obj.n, sizeof(obj.n));
+			return;
+		}
+		slot = object_slot(w, obj.p);
+		if (w->keys[slot]) {
+			put_u8(w, IMAGE_REF);
+			put_u32(w, w->ids[slot]);
+			return;
+		}
+		if (navi_type(obj) != NAVI_PAIR)
+			break;
+		// lists are written iteratively, car first
+		record_object(w, obj.p);
+		put_u8(w, IMAGE_PAIR);
+		put_object(w, navi_car(obj));
+		obj = navi_cdr(obj);
+	}
+
+	switch (navi_type(obj)) {
+	case NAVI_SYMBOL:
+		record_object(w, obj.p);
+		put_u8(w, navi_symbol_is_interned(obj) ? IMAGE_SYMBOL
+				: IMAGE_UNINTERNED);
+		put_u32(w, navi_symbol(obj)->length);
+		put_bytes(w, navi_symbol(obj)->data, navi_symbol(obj)->length);
+		break;
+	case NAVI_STRING:
+		record_object(w, obj.p);
+		put_u8(w, IMAGE_STRING);
+		put_u32(w, navi_string(obj)->size);
+		put_u32(w, navi_string(obj)->length);
+		put_bytes(w, navi_string(obj)->data, navi_string(obj)->size);
+		break;
+	case NAVI_BYTEVEC:
+		record_object(w, obj.p);
+		put_u8(w, IMAGE_BYTEVEC);
+		put_u32(w, navi_bytevec(obj)->size);
+		put_bytes(w, navi_bytevec(obj)->data, navi_bytevec(obj)->size);
+		break;
+	case NAVI_VECTOR:
+		record_object(w, obj.p);
+		put_u8(w, IMAGE_VECTOR);
+		put_u32(w, navi_vector(obj)->size);
+		for (size_t j = 0; j < navi_vector(obj)->size; j++)
+			put_object(w, navi_vector(obj)->data[j]);
+		break;
+	case NAVI_MACRO:
+	case NAVI_SPECIAL:
+	case NAVI_PROCEDURE:
+	case NAVI_PARAMETER:
+		if ((i = navi_builtin_index(obj)) >= 0) {
+			record_object(w, obj.p);
+			put_u8(w, IMAGE_BUILTIN);
+			put_u32(w, i);
+			break;
+		}
+		if (navi_type(obj) == NAVI_PARAMETER
+				|| navi_type(obj) == NAVI_SPECIAL
+				|| navi_proc_is_builtin(navi_procedure(obj)))
+			unsaveable(w, obj);
+		put_lambda(w, obj);
+		break;
+	default:
+		unsaveable(w, obj);
+	}
+}
+
+static void put_library(struct image_writer *w, struct navi_library *lib)
+{
+	struct navi_binding *binding;
+	uint32_t nr_bindings = 0;
+	navi_scope_for_each(binding, lib->env.lexical)
+		nr_bindings++;
+	put_u32(w, nr_bindings);
+	navi_scope_for_each(binding, lib->env.lexical) {
+		put_object(w, binding->symbol);
+		put_object(w, binding->object);
+	}
+}
+
+/*
+ * Write every loaded library of the current VM to a heap image at @path.
+ * Returns 0 if the file can't be written.
+ */
+int navi_save_image(const char *path, navi_env env)
+{
+	struct image_header header;
+	struct image_writer w;
+	writer_init(&w, env);
+	w.libs = loaded_libraries(&w.nr_libs);
+
+	image_stamp(&header);
+	header.nr_libraries = w.nr_libs;
+	put_bytes(&w, &header, sizeof(header));
+	for (unsigned i = 0; i < w.nr_libs; i++) {
+		put_object(&w, w.libs[i]->name);
+		put_object(&w, w.libs[i]->exports);
+	}
+	for (unsigned i = 0; i < w.nr_libs; i++)
+		put_library(&w, w.libs[i]);
+
+	int ok = writer_commit(&w, path);
+	writer_free(&w);
+	return ok;
+}
+/* Writing }}} */
+/* Reading {{{ */
+struct image_reader {
+	const unsigned char *pos;
+	const unsigned char *end;
+	navi_obj *objects;
+	uint32_t nr_objects;
+	uint32_t capacity;
+	struct navi_library **libs;
+	uint32_t nr_libs;
+	uint32_t nr_registered;
+	navi_env env;
+	jmp_buf error;
+};
+
+static _Noreturn void corrupt_image(struct image_reader *r)
+{
+	longjmp(r->error, 1);
+}
+
+static const unsigned char *get_bytes(struct image_reader *r, size_t size)
+{
+	const unsigned char *p = r->pos;
+	if (unlikely((size_t) (r->end - r->pos) < size))
+		corrupt_image(r);
+	r->pos += size;
+	return p;
+}
+
+static uint8_t get_u8(struct image_reader *r)
+{
+	return *get_bytes(r, 1);
+}
+
+static uint32_t get_u32(struct image_reader *r)
+{
+	uint32_t v;
+	memcpy(&v, get_bytes(r, sizeof(v)), sizeof(v));
+	return v;
+}
+
+/* Map the file at @path read-only.  Returns NULL on failure. */
+static void *map_file(const char *path, size_t *size)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	*size = st.st_size;
+	return map;
+}
+
+static navi_obj restore_object(struct image_reader *r, navi_obj obj)
+{
+	if (r->nr_objects == r->capacity) {
+		r->capacity = r->capacity ? r->capacity * 2 : 256;
+		r->objects = navi_critical_realloc(r->objects,
+				r->capacity * sizeof(*r->objects));
+	}
+	r->objects[r->nr_objects++] = obj;
+	return obj;
+}
+
+static navi_obj get_symbol(struct image_reader *r, bool interned)
+{
+	uint32_t len = get_u32(r);
+	const char *data = (const char*) get_bytes(r, len);
+	if (interned)
+		return restore_object(r, navi_intern(data, len,
+					navi_symbol_hash(data, len)));
+	char *str = navi_critical_malloc(len + 1);
+	memcpy(str, data, len);
+	str[len] = '\0';
+	navi_obj symbol = navi_make_uninterned(str);
+	free(str);
+	return restore_object(r, symbol);
+}
+
+static navi_obj get_object(struct image_reader *r);
+
+static navi_obj get_lambda(struct image_reader *r)
+{
+	uint8_t type = get_u8(r);
+	uint32_t lib = get_u32(r);
+	if (unlikely(lib >= r->nr_libs))
+		corrupt_image(r);
+	navi_obj name = get_object(r);
+	navi_obj args = get_object(r);
+	navi_obj body = get_object(r);
+	navi_env env = r->libs[lib]->env;
+	if (type == NAVI_MACRO)
+		return restore_object(r, navi_make_macro(args, body, name, env));
+	if (type == NAVI_PROCEDURE)
+		return restore_object(r, navi_make_procedure(args, body, name,
+					env));
+	corrupt_image(r);
+}
+
+static navi_obj get_atom(struct image_reader *r, uint8_t tag)
+{
+	navi_obj obj;
+	const unsigned char *data;
+	uint32_t size, length, i;
+	switch (tag) {
+	case IMAGE_IMMEDIATE:
+		memcpy(&obj.n, get_bytes(r, sizeof(obj.n)), sizeof(obj.n));
+		if (unlikely(navi_ptr_type(obj)))
+			corrupt_image(r);
+		return obj;
+	case IMAGE_REF:
+		i = get_u32(r);
+		if (unlikely(i >= r->nr_objects))
+			corrupt_image(r);
+		return r->objects[i];
+	case IMAGE_SYMBOL:
+	case IMAGE_UNINTERNED:
+		return get_symbol(r, tag == IMAGE_SYMBOL);
+	case IMAGE_STRING:
+		size = get_u32(r);
+		length = get_u32(r);
+		if (unlikely(length > size))
+			corrupt_image(r);
+		/* check the size against the image before allocating */
+		data = get_bytes(r, size);
+		obj = navi_make_string(size, size, length);
+		memcpy(navi_string(obj)->data, data, size);
+		return restore_object(r, obj);
+	case IMAGE_BYTEVEC:
+		size = get_u32(r);
+		data = get_bytes(r, size);
+		obj = navi_make_bytevec(size);
+		memcpy(navi_bytevec(obj)->data, data, size);
+		return restore_object(r, obj);
+	case IMAGE_VECTOR:
+		size = get_u32(r);
+		if (unlikely(size > (size_t) (r->end - r->pos)))
+			corrupt_image(r);
+		obj = navi_make_vector(size);
+		for (i = 0; i < size; i++)
+			navi_vector(obj)->data[i] = navi_make_void();
+		restore_object(r, obj);
+		for (i = 0; i < size; i++)
+			navi_vector(obj)->data[i] = get_object(r);
+		return obj;
+	case IMAGE_BUILTIN:
+		i = get_u32(r);
+		if (unlikely(!navi_builtin_name(i)))
+			corrupt_image(r);
+		return restore_object(r, navi_get_builtin(i, r->env));
+	case IMAGE_LAMBDA:
+		return get_lambda(r);
+	}
+	corrupt_image(r);
+}
+
+static navi_obj get_object(struct image_reader *r)
+{
+	struct navi_pair head, *tail = &head;
+	for (;;) {
+		uint8_t tag = get_u8(r);
+		if (tag != IMAGE_PAIR) {
+			tail->cdr = get_atom(r, tag);
+			return head.cdr;
+		}
+		navi_obj pair = navi_make_pair(navi_make_void(),
+				navi_make_void());
+		restore_object(r, pair);
+		tail->cdr = pair;
+		tail = navi_pair(pair);
+		tail->car = get_object(r);
+	}
+}
+
+static void get_library(struct image_reader *r, struct navi_library *lib)
+{
+	uint32_t nr_bindings = get_u32(r);
+	for (uint32_t i = 0; i < nr_bindings; i++) {
+		navi_obj symbol = get_object(r);
+		if (unlikely(!navi_is_symbol(symbol)))
+			corrupt_image(r);
+		navi_scope_set(lib->env.lexical, symbol, get_object(r));
+	}
+}
+
+static void read_image(struct image_reader *r)
+{
+	for (uint32_t i = 0; i < r->nr_libs; i++) {
+		navi_obj name = get_object(r);
+		navi_obj exports = get_object(r);
+		r->libs[i] = navi_make_loaded_library(name, exports, r->env);
+		r->nr_registered++;
+	}
+	for (uint32_t i = 0; i < r->nr_libs; i++)
+		get_library(r, r->libs[i]);
+}
+
+/* Forget the libraries of an image which turned out to be corrupt. */
+static void unregister_libraries(struct image_reader *r)
+{
+	for (uint32_t i = 0; i < r->nr_registered; i++) {
+		NAVI_LIST_REMOVE(r->libs[i], link);
+		navi_env_unref(r->libs[i]->env);
+		free(r->libs[i]);
+	}
+}
+
+/*
+ * Load the libraries in the heap image at @path into the current VM, as if
+ * they had been imported into @env.  This should be done before any library
+ * is imported.  Returns 0 if the file can't be read or was written by a
+ * binary with different builtins, or turns out to be corrupt.  The
+ * libraries are then loaded from source as usual.
+ */
+int navi_load_image(const char *path, navi_env env)
+{
+	size_t size;
+	struct image_header header, expected;
+	unsigned char *map = map_file(path, &size);
+	if (!map)
+		return 0;
+	if (size < sizeof(header))
+		goto fail;
+
+	image_stamp(&expected);
+	memcpy(&header, map, sizeof(header));
+	expected.nr_libraries = header.nr_libraries;
+	if (memcmp(&header, &expected, sizeof(header)))
+		goto fail;
+
+	struct image_reader r = {
+		.pos = map + sizeof(header),
+		.end = map + size,
+		.nr_libs = header.nr_libraries,
+		.env = env,
+	};
+	if (r.nr_libs > (size_t) (r.end - r.pos))
+		goto fail;
+	r.libs = navi_critical_malloc(r.nr_libs * sizeof(*r.libs) + 1);
+
+	// converting parameter values can run Scheme code
+	int ok = 1;
+	navi_gc_disable();
+	if (!setjmp(r.error)) {
+		read_image(&r);
+	} else {
+		unregister_libraries(&r);
+		ok = 0;
+	}
+	navi_gc_enable();
+
+	free(r.objects);
+	free(r.libs);
+	munmap(map, size);
+	return ok;
+fail:
+	munmap(map, size);
+	return 0;
+}
+/* Reading }}} */
+/* Library Cache {{{ */
+
+/*
+ * The library cache holds the parsed define-library form of each library
+ * source file, in the same format as heap images, so that loading a library
+ * doesn't have to parse its source again.  Cache files are named after a
+ * hash of the source path and record the path, size and modification time
+ * of the source; a cache file which doesn't match its source is ignored and
+ * rewritten.
+ *
+ * The cache lives in $NAVI_CACHE_DIR, or else $XDG_CACHE_HOME/navi or
+ * $HOME/.cache/navi.  Setting NAVI_CACHE_DIR to the empty string disables
+ * the cache.
+ */
+#define CACHE_MAGIC "NAVILIB"
+
+struct cache_key {
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t size;
+	uint32_t path_len;
+};
+
+static char *cache_dir(void)
+{
+	char *dir, *base;
+	const char *sub = "/navi";
+	if ((base = getenv("NAVI_CACHE_DIR")))
+		return base[0] ? strdup(base) : NULL;
+	if (!(base = getenv("XDG_CACHE_HOME")) || !base[0]) {
+		if (!(base = getenv("HOME")) || !base[0])
+			return NULL;
+		sub = "/.cache/navi";
+	}
+	dir = navi_critical_malloc(strlen(base) + strlen(sub) + 1);
+	strcpy(dir, base);
+	strcat(dir, sub);
+	return dir;
+}
+
+/* Returns the cache file for @source, creating the cache directory. */
+static char *cache_path(const char *source)
+{
+	char *dir = cache_dir();
+	if (!dir)
+		return NULL;
+	for (char *p = dir + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		mkdir(dir, 0755);
+		*p = '/';
+	}
+	mkdir(dir, 0755);
+
+	uint64_t hash = 14695981039346656037ULL;
+	for (const char *p = source; *p; p++)
+		hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+	size_t len = strlen(dir) + 32;
+	char *path = navi_critical_malloc(len);
+	snprintf(path, len, "%s/%016llx.navic", dir, (unsigned long long) hash);
+	free(dir);
+	return path;
+}
+
+static int cache_key(const char *source, struct cache_key *key)
+{
+	struct stat st;
+	if (stat(source, &st))
+		return 0;
+	memset(key, 0, sizeof(*key));
+	key->mtime_sec = st.st_mtim.tv_sec;
+	key->mtime_nsec = st.st_mtim.tv_nsec;
+	key->size = st.st_size;
+	key->path_len = strlen(source);
+	return 1;
+}
+
+/*
+ * Returns the define-library form of @source from the library cache, or
+ * void if it isn't cached or the cache is out of date.
+ */
+navi_obj navi_read_cached_library(const char *source, navi_env env)
+{
+	size_t size;
+	struct cache_key key, cached;
+	struct image_header header, expected;
+	volatile navi_obj defn = navi_make_void();
+	char *path = cache_path(source);
+	if (!path || !cache_key(source, &key)) {
+		free(path);
+		return defn;
+	}
+	unsigned char *map = map_file(path, &size);
+	free(path);
+	if (!map)
+		return defn;
+
+	image_stamp(&expected);
+	memcpy(expected.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	if (size < sizeof(header) + sizeof(key) + key.path_len)
+		goto out;
+	memcpy(&header, map, sizeof(header));
+	memcpy(&cached, map + sizeof(header), sizeof(cached));
+	if (memcmp(&header, &expected, sizeof(header))
+			|| memcmp(&cached, &key, sizeof(key))
+			|| memcmp(map + sizeof(header) + sizeof(key), source,
+				key.path_len))
+		goto out;
+
+	struct image_reader r = {
+		.pos = map + sizeof(header) + sizeof(key) + key.path_len,
+		.end = map + size,
+		.env = env,
+	};
+	navi_gc_disable();
+	if (!setjmp(r.error))
+		defn = get_object(&r);
+	navi_gc_enable();
+	free(r.objects);
+out:
+	munmap(map, size);
+	return defn;
+}
+
+/*
+ * Write the define-library form @defn read from @source to the library
+ * cache.  Failure is silent: the library will just be parsed again.
+ */
+void navi_cache_library(const char *source, navi_obj defn, navi_env env)
+{
+	jmp_buf error;
+	struct cache_key key;
+	struct image_header header;
+	struct image_writer w;
+	char *path = cache_path(source);
+	if (!path || !cache_key(source, &key)) {
+		free(path);
+		return;
+	}
+
+	writer_init(&w, env);
+	w.error = &error;
+	image_stamp(&header);
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	put_bytes(&w, &header, sizeof(header));
+	put_bytes(&w, &key, sizeof(key));
+	put_bytes(&w, source, key.path_len);
+	if (!setjmp(error)) {
+		put_object(&w, defn);
+		writer_commit(&w, path);
+	}
+	writer_free(&w);
+	free(path);
+}
+/* Library Cache }}} */
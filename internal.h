@@ -17,33 +17,62 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <time.h>
 #include "navi.h"
 #include "queue.h"
+#include "symbols.h"
 
 #define NAVI_ENV_HT_SIZE 64
 
 /* C types {{{ */
 
-struct navi_guard {
-	NAVI_LIST_ENTRY(navi_guard) link;
-	navi_obj obj;
-};
+NAVI_LIST_HEAD(navi_bucket, navi_binding);
 
+/*
+ * A scope is either a hash table of bindings (the global environment,
+ * library environments and dynamic scopes) or a "frame": a compact array of
+ * slots whose names are fixed when the frame is created.  Compiled code
+ * addresses frame slots directly by (depth, index); anything else finds them
+ * by name.  The names belong to the compiled code which created the frame,
+ * and the frame holds a reference to it.  Bindings added by name to a frame
+ * go into a single, unhashed bucket.
+ */
 struct navi_scope {
 	NAVI_LIST_ENTRY(navi_scope) link;
 	struct navi_scope *next;
 	unsigned int refs;
-	NAVI_LIST_HEAD(navi_guard_head, navi_guard) guards;
-	NAVI_LIST_HEAD(navi_bucket, navi_binding) bindings[NAVI_ENV_HT_SIZE];
+	unsigned int nr_slots;
+	unsigned long hash_mask;
+	struct navi_bucket *bindings;
+	const navi_obj *names;
+	struct navi_code *code;
+	struct navi_bucket frame_bindings;
+	navi_obj slots[];
 };
 
 typedef navi_obj (*navi_builtin)(unsigned, navi_obj, navi_env,
 		struct navi_procedure*);
 
+/*
+ * Builtins defined with DEFPROC take their arguments as an array.  The list
+ * argument is the original argument list when there is one, or void when the
+ * caller passed only the array (see navi_apply_argv).
+ */
+typedef navi_obj (*navi_builtin_argv)(unsigned, const navi_obj*, navi_obj,
+		navi_env, struct navi_procedure*);
+
+/* the largest argument count passed on the C stack */
+#define NAVI_ARGV_MAX 8
+
 struct navi_escape {
 	jmp_buf state;
 	navi_env env;
 	navi_obj arg;
+	/* the depth of the root stack to return to (see navi_gc_guard) */
+	size_t roots;
+	/* the extent of the bytecode VM's stacks to return to */
+	size_t vm_sp;
+	size_t vm_fp;
 };
 
 enum {
@@ -66,8 +95,27 @@ struct navi_procedure {
 		navi_obj body;
 		navi_builtin c_proc;
 	};
-	navi_obj specific;
+	navi_builtin_argv c_argv;
 	const int *types;
+	/* bit i is set if argument i is declared with a type other than NAVI_ANY */
+	uint32_t checks;
+	struct navi_code *code;
+};
+
+/*
+ * A compiled procedure body.  Which member of the union is used depends on
+ * the engine the body was compiled for.  Frames created by the code hold a
+ * reference to it, since it owns their slot names.
+ */
+struct navi_code {
+	unsigned refs;
+	enum navi_engine engine;
+	unsigned nr_slots;
+	navi_obj *names;
+	union {
+		struct node *body;
+		struct vm_function *function;
+	};
 };
 
 struct navi_vector {
@@ -85,10 +133,13 @@ struct navi_string {
 	int32_t length;   // the number of code points encoded by the string
 	int32_t capacity; // the available capacity (in bytes) of the string
 	unsigned char *data;       // the UTF-8 encoded string data
+	unsigned char buf[];       // storage for the data of small strings
 };
 
 struct navi_symbol {
-	NAVI_LIST_ENTRY(navi_symbol) link;
+	uint32_t hash;
+	uint32_t length;
+	bool interned;
 	char data[];
 };
 
@@ -145,16 +196,41 @@ struct navi_library {
 };
 
 enum {
-	NAVI_GC_MARK      = 1,
-	NAVI_GC_PROTECT   = 2,
-	NAVI_PAT_ELLIPSIS = 4,
+	NAVI_GC_MARK       = 1, /* objects not allocated from slabs */
+	NAVI_GC_PROTECT    = 2,
+	NAVI_PAT_ELLIPSIS  = 4,
+	NAVI_GC_OLD        = 8,
+	NAVI_GC_REMEMBERED = 16,
 };
 
+/*
+ * The object header.  Its fields are packed into the first word of the
+ * object, before the data (which is word-aligned).
+ */
 struct navi_object {
-	NAVI_SLIST_ENTRY(navi_object) link;
-	enum navi_type type;
-	uint16_t flags;
-	_Alignas(sizeof(int)) unsigned char data[];
+	uint8_t type;       /* enum navi_type */
+	uint8_t flags;      /* NAVI_GC_* and NAVI_PAT_ELLIPSIS */
+	uint8_t size_class; /* the slab cache the object came from (heap.c) */
+	_Alignas(sizeof(void*)) unsigned char data[];
+};
+_Static_assert(NAVI_TRAP <= UINT8_MAX, "navi_object: type doesn't fit");
+
+/*
+ * An object's size class (in its header) is the slab cache it was allocated
+ * from, or SIZE_MALLOC for objects allocated with malloc.  Pairs and thunks
+ * have caches of their own; other small objects (see heap.c) come from a
+ * family of power-of-two caches.
+ */
+enum size_class {
+	SIZE_MALLOC,
+	SIZE_PAIR,
+	SIZE_THUNK,
+	SIZE_16,
+	SIZE_32,
+	SIZE_64,
+	SIZE_128,
+	SIZE_256,
+	NR_SIZE_CLASSES
 };
 
 struct navi_binding {
@@ -163,6 +239,134 @@ struct navi_binding {
 	navi_obj object;
 };
 /* C types }}} */
+/* Interpreter Instances {{{ */
+/* the interned symbols: an open-addressing hash table (see heap.c) */
+struct navi_symtab {
+	struct navi_symbol **slots;
+	size_t mask;
+	size_t nr;
+};
+
+struct navi_object_list {
+	struct navi_object **objects;
+	size_t nr;
+	size_t size;
+};
+
+struct navi_gc_stack {
+	navi_obj *objects;
+	size_t nr;
+	size_t size;
+};
+
+struct navi_gc_stats {
+	size_t bytes;
+	size_t objects;
+	size_t threshold;
+	size_t nursery_bytes;
+	size_t minor_collections;
+	size_t major_collections;
+	/* time spent in the collector, in microseconds */
+	size_t pauses;
+	uint64_t pause_total;
+	uint64_t pause_max;
+	/* slab memory given back to the OS */
+	size_t released_bytes;
+};
+
+/* The garbage-collected heap (see heap.c). */
+struct navi_heap {
+	/* young objects allocated with malloc, and old ones */
+	struct navi_object_list nursery;
+	struct navi_object_list large;
+	/* old objects which may point into the nursery */
+	struct navi_object_list remembered;
+	struct navi_symtab symbols;
+	struct slab_cache *caches[NR_SIZE_CLASSES];
+	struct slab_cache *binding_cache;
+	struct navi_gc_stats stats;
+	/* see navi_gc_disable */
+	unsigned int disabled;
+	/* the phase of the major cycle (GC_IDLE, GC_MARK or GC_SWEEP) */
+	unsigned int phase;
+	/* a major cycle is marking (see navi_gc_write_barrier) */
+	bool marking;
+	/* a minor collection is running: young objects are traced */
+	bool minor;
+	/* time budget for one slice of a major cycle (microseconds) */
+	unsigned long budget;
+	/* empty slabs kept by each slab cache at the end of a major cycle */
+	unsigned long retention;
+	/* navi_gc_check does nothing until this many bytes are in the nursery */
+	size_t next_check;
+	struct navi_gc_stack gray;
+	struct navi_gc_stack mark_stack;
+	/* objects guarded by C code (see navi_gc_guard) */
+	struct navi_gc_stack roots;
+	struct {
+		struct slab *slabs[NR_SIZE_CLASSES];
+		size_t next;
+		size_t kept;
+		size_t end;
+	} sweep;
+};
+
+#define NAVI_FRAME_CACHE_SLOTS 8
+
+/*
+ * An interpreter instance.  Everything the interpreter keeps from one call
+ * to the next lives here, so that a process can run any number of isolated
+ * interpreters.  A VM is used by one thread at a time: the thread's current
+ * VM, set by navi_vm_enter.  Objects and environments belong to the VM that
+ * created them, and mustn't be passed to another one.
+ */
+struct navi_vm {
+	struct navi_heap heap;
+	struct navi_symbols symbols;
+	/* every scope which may hold references into the heap (environment.c) */
+	NAVI_LIST_HEAD(navi_scope_head, navi_scope) environments;
+	NAVI_LIST_HEAD(navi_lib_bucket, navi_library) libraries[NAVI_ENV_HT_SIZE];
+	/* freed frames with fewer than NAVI_FRAME_CACHE_SLOTS slots, by size,
+	 * linked through their next pointers (environment.c) */
+	struct navi_scope *free_frames[NAVI_FRAME_CACHE_SLOTS];
+	unsigned nr_free_frames[NAVI_FRAME_CACHE_SLOTS];
+	/* bumped when a binding is added to or removed from a global scope or
+	 * a compiled frame (see struct navi_ref_cache) */
+	unsigned long env_version;
+	/* the builtin objects, by name (default_bindings.c) */
+	struct navi_scope *internal_env;
+	navi_obj *builtins;
+	enum navi_engine engine;
+	/* the pending tail call (compile.c) */
+	struct {
+		struct navi_procedure *proc;
+		navi_obj args;
+	} tail_call;
+	/* the expression bounced back to navi_eval (see navi_make_bounce) */
+	struct {
+		navi_obj expr;
+		navi_env env;
+	} bounce;
+	/* the bytecode VM's stacks (vm.c) */
+	struct {
+		navi_obj *stack;
+		struct vm_frame *frames;
+		size_t stack_size;
+		size_t frames_size;
+		/* the extent of the stacks the last time control left the VM */
+		size_t sp;
+		size_t fp;
+	} bytecode;
+	/* counters for generated names */
+	unsigned int gensyms;
+	unsigned int parameters;
+	unsigned long lambdas;
+	/* the epoch of current-jiffy */
+	time_t first_second;
+};
+
+extern _Thread_local struct navi_vm *_navi_vm;
+/* Interpreter Instances }}} */
 
 #define navi_die(...) _navi_die(__FILE__, __LINE__, __VA_ARGS__)
 _Noreturn int _navi_die(const char *file, int line, const char *msg, ...);
@@ -170,6 +374,10 @@ void *navi_critical_malloc(size_t size);
 void *navi_critical_realloc(void *p, size_t size);
 
 void navi_internal_init(void);
+navi_obj navi_get_builtin(unsigned i, navi_env env);
+void navi_builtins_mark(void (*mark)(navi_obj));
+const char *navi_builtin_name(unsigned i);
+int navi_builtin_index(navi_obj obj);
 
 /* Accessors {{{ */
 #undef navi_ptr
@@ -332,9 +540,11 @@ static inline __const navi_obj navi_caddddr(navi_obj obj)
 navi_obj navi_from_spec(const struct navi_spec *spec, navi_env env);
 void navi_string_grow_storage(struct navi_string *str, long need);
 navi_obj navi_make_uninterned(const char *str);
+navi_obj navi_intern(const char *str, size_t length, uint32_t hash);
 struct navi_binding *navi_make_binding(navi_obj symbol, navi_obj object);
 navi_obj navi_make_procedure(navi_obj args, navi_obj body, navi_obj name, navi_env env);
 navi_obj navi_make_lambda(navi_obj args, navi_obj body, navi_env env);
+navi_obj navi_make_lambda_name(void);
 navi_obj navi_make_thunk(navi_obj expr, navi_env env);
 navi_obj navi_make_escape(void);
 navi_obj _navi_make_parameter(navi_obj converter);
@@ -406,19 +616,14 @@ static inline navi_obj navi_make_caselambda(size_t size)
 	return lambda;
 }
 
-#undef navi_make_apair
-static inline navi_obj navi_make_apair(const char *sym, navi_obj val)
-{
-	return navi_make_pair(navi_make_symbol(sym), val);
-}
+/* Intern a string literal, whose length is known at compile time. */
+#define navi_make_symbol_literal(str) \
+	navi_intern("" str, sizeof(str) - 1, \
+			navi_symbol_hash(str, sizeof(str) - 1))
 
-#undef navi_make_bounce
-static inline navi_obj navi_make_bounce(navi_obj object, navi_env env)
-{
-	navi_obj bounce = navi_make_thunk(object, env);
-	bounce.p->type = NAVI_BOUNCE;
-	return bounce;
-}
+#undef navi_make_apair
+#define navi_make_apair(sym, val) \
+	navi_make_pair(navi_make_symbol_literal(sym), val)
 
 #undef navi_unspecified
 static inline navi_obj navi_unspecified(void)
@@ -427,13 +632,61 @@ static inline navi_obj navi_unspecified(void)
 }
 /* Constructors }}} */
 /* Environments/Evaluation {{{ */
+void navi_env_init(void);
+void navi_env_free_all(void);
 navi_env navi_extend_environment(navi_env env, navi_obj vars, navi_obj args);
+navi_env navi_env_new_frame(navi_env env, struct navi_code *code,
+		unsigned nr_slots, const navi_obj *names);
+void navi_free_frame(struct navi_scope *frame);
+navi_obj *navi_env_cell(struct navi_scope *env, navi_obj symbol);
+navi_obj navi_dispatch_call(navi_obj proc, navi_obj call, navi_env env);
+struct navi_library *navi_make_loaded_library(navi_obj name, navi_obj exports,
+		navi_env env);
+void navi_library_mark(void (*mark)(navi_obj));
+navi_obj navi_read_cached_library(const char *source, navi_env env);
+void navi_cache_library(const char *source, navi_obj defn, navi_env env);
 
 #undef navi_env_lookup
 static inline navi_obj navi_env_lookup(struct navi_scope *env, navi_obj symbol)
 {
-	struct navi_binding *binding = navi_env_binding(env, symbol);
-	return binding == NULL ? navi_make_void() : binding->object;
+	navi_obj *cell = navi_env_cell(env, symbol);
+	return cell == NULL ? navi_make_void() : *cell;
+}
+
+#undef navi_scope_is_frame
+static inline bool navi_scope_is_frame(struct navi_scope *scope)
+{
+	return scope->bindings == &scope->frame_bindings;
+}
+
+/*
+ * An inline cache for a variable looked up by name in compiled code.  Only
+ * bindings in a global scope (the top level or a library) are cached, and
+ * only at sites whose frames lead directly to that scope: @depth frames up
+ * from the current one.  Those frames have no slot of that name, so the
+ * lookup can only change if a binding is added to or removed from them or
+ * the global scope, which bumps the environment version.
+ */
+struct navi_ref_cache {
+	unsigned long version;
+	struct navi_scope *scope;
+	struct navi_binding *binding;
+};
+
+navi_obj *_navi_env_cached_cell(struct navi_scope *env,
+		struct navi_scope *global, navi_obj symbol,
+		struct navi_ref_cache *cache);
+
+static inline navi_obj *navi_env_cached_cell(struct navi_scope *env,
+		unsigned depth, navi_obj symbol, struct navi_ref_cache *cache)
+{
+	struct navi_scope *scope = env;
+	for (unsigned i = 0; i < depth; i++)
+		scope = scope->next;
+	if (likely(cache->scope == scope
+				&& cache->version == _navi_vm->env_version))
+		return &cache->binding->object;
+	return _navi_env_cached_cell(env, scope, symbol, cache);
 }
 
 #undef navi_apply
@@ -446,7 +699,40 @@ static inline navi_obj navi_apply(struct navi_procedure *proc, navi_obj args,
 	};
 	return _navi_apply(proc, args, proc_env);
 }
+
+/*
+ * Apply @proc to the @argc objects at @argv without building an argument
+ * list, if @proc is a builtin that takes an array.  The caller must keep the
+ * arguments reachable (e.g. with navi_gc_guard) for the duration of the call.
+ */
+navi_obj _navi_apply_argv(struct navi_procedure *proc, unsigned argc,
+		const navi_obj *argv, navi_env env);
+
+static inline navi_obj navi_apply_argv(struct navi_procedure *proc,
+		unsigned argc, const navi_obj *argv, navi_env env)
+{
+	navi_env proc_env = {
+		.lexical = proc->env,
+		.dynamic = env.dynamic
+	};
+	return _navi_apply_argv(proc, argc, argv, proc_env);
+}
+
+/* Call @fn with the first @copy elements of @args copied to an array. */
+navi_obj _navi_call_argv(navi_builtin_argv fn, unsigned argc, unsigned copy,
+		navi_obj args, navi_env env, struct navi_procedure *proc);
 /* Environments/Evaluation }}} */
+/* Compiler {{{ */
+struct navi_code *navi_compile(struct navi_procedure *proc);
+struct navi_code *navi_code_ref(struct navi_code *code);
+void navi_code_unref(struct navi_code *code);
+navi_obj navi_code_apply(struct navi_procedure *proc, navi_obj args,
+		navi_env env);
+struct navi_code *navi_compile_bytecode(struct navi_procedure *proc);
+navi_obj navi_vm_apply(struct navi_procedure *proc, navi_obj args,
+		navi_env env);
+void navi_vm_mark(void (*mark)(navi_obj));
+/* Compiler }}} */
 /* Types {{{ */
 #undef navi_is_immediate
 static inline __const bool navi_is_immediate(navi_obj obj)
@@ -476,7 +762,7 @@ static inline __const enum navi_type navi_type(navi_obj obj)
 		return NAVI_FIXNUM;
 	if (obj.n & 2)
 		return navi_immediate_type(obj);
-	return obj.p->type;
+	return (enum navi_type) obj.p->type;
 }
 
 #undef navi_ptr_type
@@ -567,8 +853,6 @@ NAVI_TYPE_PREDICATE(navi_is_escape, NAVI_ESCAPE)
 NAVI_TYPE_PREDICATE(navi_is_parameter, NAVI_PARAMETER)
 #undef navi_is_environment
 NAVI_TYPE_PREDICATE(navi_is_environment, NAVI_ENVIRONMENT)
-#undef navi_is_bounce
-NAVI_TYPE_PREDICATE(navi_is_bounce, NAVI_BOUNCE)
 #undef NAVI_TYPE_PREDICATE
 
 #undef navi_is_byte
@@ -591,9 +875,23 @@ static inline __const bool navi_is_list(navi_obj obj)
 }
 /* Types }}} */
 /* Memory Management {{{ */
-extern unsigned int _navi_gc_disabled;
+#define _navi_gc_disabled (_navi_vm->heap.disabled)
 void navi_gc_collect(void);
-void navi_gc_check(void);
+void _navi_gc_check(void);
+
+/* True if enough has been allocated since the last navi_gc_check to do work. */
+static inline bool navi_gc_pending(void)
+{
+	return _navi_vm->heap.stats.nursery_bytes >= _navi_vm->heap.next_check;
+}
+
+static inline void navi_gc_check(void)
+{
+	if (unlikely(navi_gc_pending()))
+		_navi_gc_check();
+}
+unsigned long navi_gc_set_budget(unsigned long usec);
+unsigned long navi_gc_set_retention(unsigned long slabs);
 
 #undef navi_gc_disable
 static inline void navi_gc_disable(void)
@@ -647,19 +945,83 @@ static inline navi_obj navi_gc_release(navi_obj obj)
  * GC "guards":
  *
  *   A guarded object *and every object it references* are protected from
- *   garbage collection.  Guards are less efficient than the protect/release
- *   mechanism (in terms of both time and space), however:
+ *   garbage collection.  Guarded objects are kept on a stack of roots in the
+ *   VM: navi_gc_guard pushes an object and returns the depth of the stack
+ *   before the push, and navi_gc_unguard pops the stack back to a depth,
+ *   releasing everything guarded since.  Code which guards objects
+ *   conditionally can take the depth from navi_gc_roots instead.
  *
- *     * It is not necessary to explicitly protect objects referenced by a
- *       guarded object.
- *     * The lifetime of a guard is the same as the lifetime of its
- *       associated environment, so it is not necessary to manually clean up
- *       after guards.
+ *   Guards are released in reverse order.  Invoking an escape continuation
+ *   pops the guards of the calls it unwinds (see navi_escape_unwind).
  *
  *   Guards should almost always be preferred to protect/release.
  */
-struct navi_guard *navi_gc_guard(navi_obj obj, navi_env env);
-void navi_gc_unguard(struct navi_guard *guard);
+void _navi_gc_grow_roots(void);
+
+static inline size_t navi_gc_roots(void)
+{
+	return _navi_vm->heap.roots.nr;
+}
+
+static inline size_t navi_gc_guard(navi_obj obj)
+{
+	struct navi_gc_stack *roots = &_navi_vm->heap.roots;
+	if (unlikely(roots->nr == roots->size))
+		_navi_gc_grow_roots();
+	roots->objects[roots->nr] = obj;
+	return roots->nr++;
+}
+
+static inline void navi_gc_unguard(size_t depth)
+{
+	_navi_vm->heap.roots.nr = depth;
+}
+
+/*
+ * Pop the root stack and the bytecode VM's stacks back to where @esc was
+ * captured, before jumping to it.
+ */
+static inline void navi_escape_unwind(struct navi_escape *esc)
+{
+	navi_gc_unguard(esc->roots);
+	_navi_vm->bytecode.sp = esc->vm_sp;
+	_navi_vm->bytecode.fp = esc->vm_fp;
+}
+
+/*
+ * Write barrier:
+ *
+ *   Objects start out in the nursery, and are promoted to the old generation
+ *   when they survive a collection.  Minor collections only trace objects in
+ *   the nursery, so every store of a reference into an object which may be
+ *   old must be followed by a call to navi_gc_write_barrier, which records
+ *   old objects that point into the nursery.  While a major collection is
+ *   marking incrementally, the barrier also shades the stored object.
+ *
+ *   An object can't be old until a collection has run after its creation;
+ *   since collections only happen in navi_gc_check, stores into an object
+ *   which was allocated after the last call that could reach navi_gc_check
+ *   (navi_eval, navi_apply, ...) don't need the barrier.  navi_set_car and
+ *   navi_set_cdr include it.  Environments are always traced in full, so
+ *   binding updates don't need it either.
+ */
+#define _navi_gc_marking (_navi_vm->heap.marking)
+void _navi_gc_remember(struct navi_object *obj);
+void _navi_gc_shade(navi_obj obj);
+
+#undef navi_gc_write_barrier
+static inline void navi_gc_write_barrier(struct navi_object *obj,
+		navi_obj value)
+{
+	if (!navi_ptr_type(value))
+		return;
+	if (unlikely(_navi_gc_marking)
+			&& (value.p->flags & NAVI_GC_OLD))
+		_navi_gc_shade(value);
+	if (unlikely((obj->flags & (NAVI_GC_OLD | NAVI_GC_REMEMBERED)) == NAVI_GC_OLD)
+			&& !(value.p->flags & NAVI_GC_OLD))
+		_navi_gc_remember(obj);
+}
 
 struct navi_scope *_navi_make_scope(void);
 struct navi_scope *navi_make_scope(void);
@@ -693,13 +1055,14 @@ static inline void navi_env_unref(navi_env env)
 	_navi_scope_unref(env.dynamic);
 }
 
+/* Iterate over the named bindings in a scope (not including frame slots). */
 #define navi_scope_for_each(binding, scope) \
-	for (unsigned navi_i___ = 0; navi_i___ < NAVI_ENV_HT_SIZE; navi_i___++) \
-		NAVI_LIST_FOREACH(binding, &scope->bindings[navi_i___], link)
+	for (unsigned navi_i___ = 0; navi_i___ <= (scope)->hash_mask; navi_i___++) \
+		NAVI_LIST_FOREACH(binding, &(scope)->bindings[navi_i___], link)
 
 #define navi_scope_for_each_safe(binding, n, scope) \
-	for (unsigned navi_i___ = 0; navi_i___ < NAVI_ENV_HT_SIZE; navi_i___++) \
-		NAVI_LIST_FOREACH_SAFE(binding, &scope->bindings[navi_i___], link, n)
+	for (unsigned navi_i___ = 0; navi_i___ <= (scope)->hash_mask; navi_i___++) \
+		NAVI_LIST_FOREACH_SAFE(binding, &(scope)->bindings[navi_i___], link, n)
 
 /* Memory Management }}} */
 /* Procedures {{{ */
@@ -721,6 +1084,32 @@ static inline bool navi_arity_satisfied(struct navi_procedure *p, unsigned n)
 	return n == p->arity
 		|| ((p->flags & NAVI_PROC_VARIADIC) && n > p->arity);
 }
+
+bool navi_is_type(navi_obj obj, int type);
+
+/* Check @obj against a declared argument type (see navi_procedure.types). */
+static inline bool navi_type_ok(int type, navi_obj obj)
+{
+	if (likely(type >= 0))
+		return navi_type(obj) == (unsigned)type;
+	return navi_is_type(obj, type);
+}
+
+/*
+ * Returns true if the builtin @p can be called with the @argc objects at
+ * @argv as they are: the count is right and every declared type matches.
+ */
+static inline bool navi_argv_ok(struct navi_procedure *p, unsigned argc,
+		const navi_obj *argv)
+{
+	if (unlikely(!navi_arity_satisfied(p, argc)))
+		return false;
+	for (uint32_t checks = p->checks, i = 0; checks; checks >>= 1, i++) {
+		if ((checks & 1) && unlikely(!navi_type_ok(p->types[i], argv[i])))
+			return false;
+	}
+	return true;
+}
 /* Procedures }}} */
 /* Pairs/Lists {{{ */
 navi_obj navi_vlist(navi_obj first, va_list ap);
@@ -728,17 +1117,27 @@ navi_obj _navi_list(navi_obj first, ...);
 #define navi_list(...) _navi_list(__VA_ARGS__, navi_make_void())
 int navi_list_length_safe(navi_obj list);
 bool navi_is_list_of(navi_obj list, int type, bool allow_dotted_tail);
+navi_obj navi_list_from_argv(unsigned argc, const navi_obj *argv);
+
+/* The argument list of a DEFPROC builtin, built on demand. */
+static inline navi_obj navi_argv_list(navi_obj list, unsigned argc,
+		const navi_obj *argv)
+{
+	return navi_is_void(list) ? navi_list_from_argv(argc, argv) : list;
+}
 
 #undef navi_set_car
 static inline void navi_set_car(navi_obj cons, navi_obj obj)
 {
 	navi_pair(cons)->car = obj;
+	navi_gc_write_barrier(cons.p, obj);
 }
 
 #undef navi_set_cdr
 static inline void navi_set_cdr(navi_obj cons, navi_obj obj)
 {
 	navi_pair(cons)->cdr = obj;
+	navi_gc_write_barrier(cons.p, obj);
 }
 
 #undef navi_last_cons
@@ -793,11 +1192,37 @@ static inline bool navi_is_output_port(navi_obj obj)
 }
 
 /* Ports }}} */
+/* Strings {{{ */
+static inline bool navi_string_is_inline(struct navi_string *str)
+{
+	return str->data == str->buf;
+}
+/* Strings }}} */
 /* Symbols {{{ */
 #undef navi_symbol_is_interned
 static inline bool navi_symbol_is_interned(navi_obj symbol)
 {
-	return navi_symbol(symbol)->link.le_prev;
+	return navi_symbol(symbol)->interned;
+}
+
+/*
+ * Symbol names are hashed with 32-bit FNV-1a.  Callers which already walk
+ * the name (e.g. the reader) can hash it as they go with
+ * navi_symbol_hash_step and intern it with navi_intern.
+ */
+#define NAVI_SYMBOL_HASH_INIT 2166136261u
+
+static inline uint32_t navi_symbol_hash_step(uint32_t hash, unsigned char c)
+{
+	return (hash ^ c) * 16777619u;
+}
+
+static inline uint32_t navi_symbol_hash(const char *str, size_t length)
+{
+	uint32_t hash = NAVI_SYMBOL_HASH_INIT;
+	for (size_t i = 0; i < length; i++)
+		hash = navi_symbol_hash_step(hash, str[i]);
+	return hash;
 }
 /* Symbols }}} */
 /* Vectors {{{ */
@@ -847,10 +1272,37 @@ static inline bool navi_symbol_eq(navi_obj expr, navi_obj symbol)
 	return navi_is_symbol(expr) && expr.p == symbol.p;
 }
 
+/*
+ * Bounces:
+ *
+ *   An expression in tail position is bounced back to the trampoline in
+ *   navi_eval rather than evaluated on top of the C stack.  The expression
+ *   and its environment are left in the VM, and a marker of type
+ *   NAVI_BOUNCE is returned in their place.  There is only one pending
+ *   bounce, so a bounce must be returned straight up to whatever forces it
+ *   (navi_eval or navi_force_tail) before anything else is evaluated.
+ */
+extern struct navi_object _navi_bounce;
+
+#undef navi_make_bounce
+static inline navi_obj navi_make_bounce(navi_obj expr, navi_env env)
+{
+	_navi_vm->bounce.expr = expr;
+	_navi_vm->bounce.env = env;
+	navi_env_ref(env);
+	return (navi_obj) { .p = &_navi_bounce };
+}
+
+#undef navi_is_bounce
+static inline __const bool navi_is_bounce(navi_obj obj)
+{
+	return obj.p == &_navi_bounce;
+}
+
 #undef navi_force_tail
 static inline navi_obj navi_force_tail(navi_obj obj, navi_env env)
 {
-	if (navi_type(obj) == NAVI_BOUNCE)
+	if (navi_is_bounce(obj))
 		return navi_eval(obj, env);
 	return obj;
 }
@@ -859,6 +1311,5 @@ static inline navi_obj navi_force_tail(navi_obj obj, navi_env env)
 #include "error.h"
 #include "lib.h"
 #include "macros.h"
-#include "symbols.h"
 
 #endif
@@ -194,6 +194,8 @@ DECLARE(vector_to_string);
 DECLARE(string_fill);
 DECLARE(string_copy);
 DECLARE(string_copy_to);
+DECLARE(string_to_symbol);
+DECLARE(symbol_to_string);
 
 DECLARE(vectorp);
 DECLARE(make_vector);
@@ -228,5 +230,8 @@ DECLARE(env_show);
 DECLARE(gc_collect);
 DECLARE(gc_count);
 DECLARE(gc_stats);
+DECLARE(gc_set_budget);
+DECLARE(gc_set_retention);
+DECLARE(gc_set_slab_arena);
 
 #endif
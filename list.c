@@ -37,6 +37,14 @@ navi_obj _navi_list(navi_obj first, ...)
 	return list;
 }
 
+navi_obj navi_list_from_argv(unsigned argc, const navi_obj *argv)
+{
+	navi_obj list = navi_make_nil();
+	while (argc--)
+		list = navi_make_pair(argv[argc], list);
+	return list;
+}
+
 int navi_list_length(navi_obj list)
 {
 	int i;
@@ -207,17 +215,14 @@ DEFUN(list_copy, "list-copy", 1, 0, NAVI_LIST)
 
 DEFUN(append, "append", 1, NAVI_PROC_VARIADIC, NAVI_ANY)
 {
-	navi_obj cons, first, last;
+	navi_obj first, last;
 	first = last = navi_make_pair(navi_make_nil(), navi_make_nil());
-	navi_list_for_each(cons, scm_args) {
-		if (navi_is_last_pair(cons)) {
-			navi_set_cdr(last, navi_car(cons));
-			break;
-		}
-		navi_type_check_proper_list(navi_car(cons), scm_env);
-		navi_set_cdr(last, navi_list_copy(navi_car(cons)));
+	for (unsigned i = 0; i < scm_nr_args - 1; i++) {
+		navi_type_check_proper_list(scm_argv[i], scm_env);
+		navi_set_cdr(last, navi_list_copy(scm_argv[i]));
 		last = navi_last_cons(last);
 	}
+	navi_set_cdr(last, scm_argv[scm_nr_args-1]);
 	return navi_cdr(first);
 }
 
@@ -402,13 +407,12 @@ static navi_obj do_apply(navi_obj proc, navi_obj args, navi_env env)
 	return navi_force_tail(navi_apply(navi_procedure(proc), args, env), env);
 }
 
-static void cons_array_fill(navi_obj *array, navi_obj args, navi_env env)
+static void cons_array_fill(navi_obj *array, unsigned argc,
+		const navi_obj *argv, navi_env env)
 {
-	navi_obj cons;
-	int i = 0;
-	navi_list_for_each(cons, args) {
-		array[i] = navi_car(cons);
-		navi_type_check_list(array[i++], env);
+	for (unsigned i = 0; i < argc; i++) {
+		array[i] = argv[i];
+		navi_type_check_list(array[i], env);
 	}
 }
 
@@ -430,7 +434,7 @@ DEFUN(for_each, "for-each", 2, NAVI_PROC_VARIADIC, NAVI_PROCEDURE, NAVI_ANY)
 {
 	navi_obj cons[scm_nr_args-1];
 	navi_check_arity(scm_arg1, scm_nr_args-1, scm_env);
-	cons_array_fill(cons, navi_cdr(scm_args), scm_env);
+	cons_array_fill(cons, scm_nr_args-1, scm_argv+1, scm_env);
 	for (;;) {
 		if (cons_array_terminated(cons, scm_nr_args-1))
 			break;
@@ -443,10 +447,12 @@ DEFUN(for_each, "for-each", 2, NAVI_PROC_VARIADIC, NAVI_PROCEDURE, NAVI_ANY)
 DEFUN(map, "map", 2, NAVI_PROC_VARIADIC, NAVI_PROCEDURE, NAVI_ANY)
 {
 	navi_obj result, last;
+	size_t guard;
 	navi_obj cons[scm_nr_args-1];
 	navi_check_arity(scm_arg1, scm_nr_args-1, scm_env);
-	cons_array_fill(cons, navi_cdr(scm_args), scm_env);
+	cons_array_fill(cons, scm_nr_args-1, scm_argv+1, scm_env);
 	result = last = navi_make_pair(navi_make_nil(), navi_make_nil());
+	guard = navi_gc_guard(result);
 	for (;;) {
 		navi_obj elm;
 		if (cons_array_terminated(cons, scm_nr_args-1))
@@ -456,5 +462,6 @@ DEFUN(map, "map", 2, NAVI_PROC_VARIADIC, NAVI_PROCEDURE, NAVI_ANY)
 		last = navi_cdr(last);
 		cons_array_advance(cons, scm_nr_args-1);
 	}
+	navi_gc_unguard(guard);
 	return navi_cdr(result);
 }
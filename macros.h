@@ -8,38 +8,57 @@
 #ifndef _NAVI_MACROS_H
 #define _NAVI_MACROS_H
 
+#include <limits.h>
 #include "internal.h"
 
 #define SCM_DECL(name) scm_decl_##name
 
-#define DEFPROC(_type, cname, scmname, _arity, _flags, ...)                  \
+/*
+ * Builtins are defined as functions of an argument array.  DEFPROC also
+ * defines scm_<cname>, an adapter taking an argument list, which copies the
+ * first @_copy arguments into an array.  Special forms and macros only ever
+ * access their arguments through scm_arg1..scm_arg5 and scm_args, so there's
+ * no point copying more than that.
+ */
+#define DEFPROC(_type, _copy, cname, scmname, _arity, _flags, ...)           \
 	static const int scm_typedecl_##cname[] = { __VA_ARGS__ };           \
 	_Static_assert(sizeof(scm_typedecl_##cname)/sizeof(int) == _arity+1, \
 			"DEFPROC: too few types for given arity");           \
-	navi_obj scm_##cname(unsigned, navi_obj, navi_env,                   \
-			struct navi_procedure*);                             \
+	_Static_assert(_arity <= 32, "DEFPROC: arity too large");            \
+	static navi_obj scm_argv_##cname(unsigned, const navi_obj*, navi_obj,\
+			navi_env, struct navi_procedure*);                   \
+	navi_obj scm_##cname(unsigned scm_nr_args, navi_obj scm_list,        \
+			navi_env scm_env, struct navi_procedure *scm_proc)   \
+	{                                                                    \
+		unsigned copy = scm_nr_args < _copy ? scm_nr_args : _copy;   \
+		return _navi_call_argv(scm_argv_##cname, scm_nr_args, copy,  \
+				scm_list, scm_env, scm_proc);                \
+	}                                                                    \
 	const struct navi_spec SCM_DECL(cname) = {                           \
 		.proc = {                                                    \
 			.flags  = _flags | NAVI_PROC_BUILTIN,                \
 			.arity  = _arity,                                    \
 			.c_proc = scm_##cname,                               \
+			.c_argv = scm_argv_##cname,                          \
 			.types  = scm_typedecl_##cname,                      \
 		},                                                           \
 		.ident = scmname,                                            \
 		.type  = _type,                                              \
 	};                                                                   \
-	navi_obj scm_##cname(unsigned scm_nr_args, navi_obj scm_args,        \
+	static navi_obj scm_argv_##cname(unsigned scm_nr_args,               \
+			const navi_obj *scm_argv, navi_obj scm_list,         \
 			navi_env scm_env, struct navi_procedure *scm_proc)
 
-#define DEFUN(...)      DEFPROC(NAVI_PROCEDURE, __VA_ARGS__, 0)
-#define DEFMACRO(...)   DEFPROC(NAVI_MACRO,     __VA_ARGS__, 0)
-#define DEFSPECIAL(...) DEFPROC(NAVI_SPECIAL,   __VA_ARGS__, 0)
+#define DEFUN(...)      DEFPROC(NAVI_PROCEDURE, UINT_MAX, __VA_ARGS__, 0)
+#define DEFMACRO(...)   DEFPROC(NAVI_MACRO,     5,        __VA_ARGS__, 0)
+#define DEFSPECIAL(...) DEFPROC(NAVI_SPECIAL,   5,        __VA_ARGS__, 0)
 
-#define scm_arg1 navi_car(scm_args)
-#define scm_arg2 navi_cadr(scm_args)
-#define scm_arg3 navi_caddr(scm_args)
-#define scm_arg4 navi_cadddr(scm_args)
-#define scm_arg5 navi_caddddr(scm_args)
+#define scm_arg1 scm_argv[0]
+#define scm_arg2 scm_argv[1]
+#define scm_arg3 scm_argv[2]
+#define scm_arg4 scm_argv[3]
+#define scm_arg5 scm_argv[4]
+#define scm_args navi_argv_list(scm_list, scm_nr_args, scm_argv)
 
 #define STRING_LITERAL(value)                                                \
 	((const struct navi_spec) {                                          \
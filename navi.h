@@ -78,6 +78,14 @@ enum {
 
 void navi_init(void);
 
+/* Interpreter Instances {{{ */
+struct navi_vm;
+struct navi_vm *navi_vm_create(void);
+void navi_vm_destroy(struct navi_vm *vm);
+void navi_vm_enter(struct navi_vm *vm);
+void navi_vm_leave(void);
+/* Interpreter Instances }}} */
+
 /* Memory Management {{{ */
 void _navi_extern_scope_unref(struct navi_scope *scope);
 #define _navi_scope_unref(scope) _navi_extern_scope_unref(scope)
@@ -174,7 +182,16 @@ navi_obj navi_extern_make_char(unsigned long c);
 void navi_set_command_line(char *argv[], navi_env env);
 /* System Interface }}} */
 /* Environments/Evaluation {{{ */
+enum navi_engine {
+	NAVI_ENGINE_TREE,
+	NAVI_ENGINE_CLOSURE,
+	NAVI_ENGINE_VM,
+};
+
+void navi_set_engine(enum navi_engine engine);
 void navi_add_lib_search_path(const char *path, navi_env env);
+int navi_save_image(const char *path, navi_env env);
+int navi_load_image(const char *path, navi_env env);
 navi_obj navi_get_internal(navi_obj symbol, navi_env env);
 navi_env navi_get_global_env(navi_env env);
 struct navi_binding *navi_env_binding(struct navi_scope *env, navi_obj symbol);
@@ -189,6 +206,12 @@ navi_env navi_interaction_environment(void);
 navi_obj navi_capture_env(navi_env env);
 void navi_import(navi_obj imports, navi_env env);
 navi_obj navi_eval(navi_obj expr, navi_env env);
+/*
+ * _navi_apply may return a bounce (NAVI_BOUNCE): a tail call left pending in
+ * the VM.  A VM has only one pending bounce, so it must be forced with
+ * navi_force_tail before anything else is evaluated on that VM.  navi_eval
+ * and navi_apply force bounces themselves.
+ */
 navi_obj _navi_apply(struct navi_procedure *proc, navi_obj args, navi_env env);
 navi_obj navi_call_escape(navi_obj escape, navi_obj arg, navi_env env);
 
@@ -40,7 +40,12 @@ usage: %s [OPTION ...] [FILENAME [ARGUMENT ...]]\n\
   FILENAME is a Scheme source file, or '-' to read from standard input.\n\
   OPTION may be one of the following:\n\
 \n\
+    -E, --engine NAME        evaluate with engine NAME (closure, tree or vm)\n\
+    -I, --image PATHNAME     load the standard libraries from a heap image\n\
     -L, --lib-path PATHNAME  add PATHNAME to the library search paths\n\
+        --save-image PATHNAME\n\
+                             save the standard libraries to a heap image\n\
+                             and exit\n\
     -h, --help               display this text and exit\n\
         --version            display version and exit\n", name);
 	exit(status);
@@ -53,14 +58,40 @@ static void version(void)
 }
 
 static struct option long_options[] = {
-	{ "lib-path", required_argument, 0, 'L' },
-	{ "help",     no_argument,       0, 'h' },
-	{ "version",  no_argument,       0, 'V' },
+	{ "engine",     required_argument, 0, 'E' },
+	{ "image",      required_argument, 0, 'I' },
+	{ "lib-path",   required_argument, 0, 'L' },
+	{ "save-image", required_argument, 0, 'S' },
+	{ "help",       no_argument,       0, 'h' },
+	{ "version",    no_argument,       0, 'V' },
 };
 
+static const struct {
+	const char *name;
+	enum navi_engine engine;
+} engines[] = {
+	{ "closure", NAVI_ENGINE_CLOSURE },
+	{ "tree",    NAVI_ENGINE_TREE    },
+	{ "vm",      NAVI_ENGINE_VM      },
+};
+
+static void set_engine(const char *name, const char *argv0)
+{
+	for (size_t i = 0; i < sizeof(engines)/sizeof(*engines); i++) {
+		if (!strcmp(engines[i].name, name)) {
+			navi_set_engine(engines[i].engine);
+			return;
+		}
+	}
+	fprintf(stderr, "%s: unknown engine '%s'\n", argv0, name);
+	usage(argv0, EXIT_FAILURE);
+}
+
 struct navi_options {
 	char **argv;
 	char *filename;
+	char *image;
+	char *save_image;
 	navi_env env;
 };
 
@@ -69,10 +100,19 @@ void parse_opts(int argc, char *argv[], struct navi_options *options)
 	int options_index = 0;
 	navi_obj cons, lib_paths = navi_make_nil();
 	for (;;) {
-		int c = getopt_long(argc, argv, "L:h", long_options, &options_index);
+		int c = getopt_long(argc, argv, "E:I:L:h", long_options, &options_index);
 		if (c < 0)
 			break;
 		switch (c) {
+		case 'E':
+			set_engine(optarg, argv[0]);
+			break;
+		case 'I':
+			options->image = optarg;
+			break;
+		case 'S':
+			options->save_image = optarg;
+			break;
 		case 'L':
 			lib_paths = navi_make_pair((navi_obj) { .v = optarg },
 						lib_paths);
@@ -131,10 +171,22 @@ static _Noreturn void repl(struct navi_options *options)
 	exit(0);
 }
 
+static _Noreturn void save_image(struct navi_options *options,
+		const char *argv0)
+{
+	navi_env env = _navi_interaction_environment(options->env);
+	if (!navi_save_image(options->save_image, env)) {
+		fprintf(stderr, "%s: cannot write heap image '%s'\n", argv0,
+				options->save_image);
+		exit(EXIT_FAILURE);
+	}
+	exit(EXIT_SUCCESS);
+}
+
 static void program(struct navi_options *options, navi_obj port)
 {
 	navi_env env = options->env;
-	struct navi_guard *guard = navi_gc_guard(port, env);
+	size_t guard = navi_gc_guard(port);
 	navi_set_command_line(options->argv, env);
 	while (!navi_is_eof(navi_eval(navi_read(navi_port(port), env), env)))
 		/* nothing */;
@@ -145,11 +197,18 @@ int main(int argc, char *argv[])
 {
 	navi_init();
 	struct navi_options options = {
-		.argv      = &argv[argc],
-		.filename  = NULL,
-		.env       = navi_empty_environment(),
+		.argv       = &argv[argc],
+		.filename   = NULL,
+		.image      = NULL,
+		.save_image = NULL,
+		.env        = navi_empty_environment(),
 	};
 	parse_opts(argc, argv, &options);
+	if (options.image && !navi_load_image(options.image, options.env))
+		fprintf(stderr, "%s: cannot load heap image '%s'\n", argv[0],
+				options.image);
+	if (options.save_image)
+		save_image(&options, argv[0]);
 	if (options.filename) {
 		navi_obj port;
 		if (!strcmp(options.filename, "-")) {
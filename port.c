@@ -334,23 +334,26 @@ navi_obj navi_current_error_port(navi_env env)
 	return navi_env_lookup(env.dynamic, navi_sym_current_error);
 }
 
-static struct navi_port *get_port(navi_obj fallback, navi_obj args, navi_env env)
+static struct navi_port *get_port(navi_obj fallback, unsigned argc,
+		const navi_obj *argv, navi_env env)
 {
-	if (navi_is_nil(args))
+	if (argc == 0)
 		return navi_port_cast(navi_env_lookup(env.dynamic, fallback), env);
-	return navi_port_cast(navi_car(args), env);
+	return navi_port_cast(argv[0], env);
 }
 
-static inline struct navi_port *get_input_port(navi_obj args, navi_env env)
+static inline struct navi_port *get_input_port(unsigned argc,
+		const navi_obj *argv, navi_env env)
 {
-	struct navi_port *p = get_port(navi_sym_current_input, args, env);
+	struct navi_port *p = get_port(navi_sym_current_input, argc, argv, env);
 	check_input_port(p, env);
 	return p;
 }
 
-static inline struct navi_port *get_output_port(navi_obj args, navi_env env)
+static inline struct navi_port *get_output_port(unsigned argc,
+		const navi_obj *argv, navi_env env)
 {
-	struct navi_port *p = get_port(navi_sym_current_output, args, env);
+	struct navi_port *p = get_port(navi_sym_current_output, argc, argv, env);
 	check_output_port(p, env);
 	return p;
 }
@@ -563,72 +566,72 @@ DEFUN(eof_object, "eof-object", 0, 0)
 
 DEFUN(read_u8, "read-u8", 0, NAVI_PROC_VARIADIC)
 {
-	struct navi_port *p = get_input_port(scm_args, scm_env);
+	struct navi_port *p = get_input_port(scm_nr_args, scm_argv, scm_env);
 	return navi_port_read_byte(p, scm_env);
 }
 
 DEFUN(peek_u8, "peek-u8", 0, NAVI_PROC_VARIADIC)
 {
-	struct navi_port *p = get_input_port(scm_args, scm_env);
+	struct navi_port *p = get_input_port(scm_nr_args, scm_argv, scm_env);
 	return navi_port_peek_byte(p, scm_env);
 }
 
 DEFUN(read_char, "read-char", 0, NAVI_PROC_VARIADIC)
 {
-	struct navi_port *p = get_input_port(scm_args, scm_env);
+	struct navi_port *p = get_input_port(scm_nr_args, scm_argv, scm_env);
 	return navi_port_read_char(p, scm_env);
 }
 
 DEFUN(peek_char, "peek-char", 0, NAVI_PROC_VARIADIC)
 {
-	struct navi_port *p = get_input_port(scm_args, scm_env);
+	struct navi_port *p = get_input_port(scm_nr_args, scm_argv, scm_env);
 	return navi_port_peek_char(p, scm_env);
 }
 
 DEFUN(read, "read", 0, NAVI_PROC_VARIADIC)
 {
-	struct navi_port *p = get_input_port(scm_args, scm_env);
+	struct navi_port *p = get_input_port(scm_nr_args, scm_argv, scm_env);
 	return navi_read(p, scm_env);
 }
 
 DEFUN(write_u8, "write-u8", 1, NAVI_PROC_VARIADIC, NAVI_BYTE)
 {
-	struct navi_port *p = get_output_port(navi_cdr(scm_args), scm_env);
+	struct navi_port *p = get_output_port(scm_nr_args-1, scm_argv+1, scm_env);
 	navi_port_write_char(navi_fixnum(scm_arg1), p, scm_env);
 	return navi_unspecified();
 }
 
 DEFUN(write_char, "write-char", 1, NAVI_PROC_VARIADIC, NAVI_CHAR)
 {
-	struct navi_port *p = get_output_port(navi_cdr(scm_args), scm_env);
+	struct navi_port *p = get_output_port(scm_nr_args-1, scm_argv+1, scm_env);
 	navi_port_write_char(navi_char(scm_arg1), p, scm_env);
 	return navi_unspecified();
 }
 
 DEFUN(write_string, "write-string", 1, NAVI_PROC_VARIADIC, NAVI_STRING)
 {
-	struct navi_port *p = get_output_port(navi_cdr(scm_args), scm_env);
+	struct navi_port *p = get_output_port(scm_nr_args-1, scm_argv+1, scm_env);
 	navi_port_write_cstr((char*)navi_string(scm_arg1)->data, p, scm_env);
 	return navi_unspecified();
 }
 
 DEFUN(display, "display", 1, NAVI_PROC_VARIADIC, NAVI_ANY)
 {
-	struct navi_port *p = get_output_port(navi_cdr(scm_args), scm_env);
+	struct navi_port *p = get_output_port(scm_nr_args-1, scm_argv+1, scm_env);
 	navi_port_display(p, scm_arg1, scm_env);
 	return navi_unspecified();
 }
 
 DEFUN(write, "write", 1, NAVI_PROC_VARIADIC, NAVI_ANY)
 {
-	struct navi_port *p = get_output_port(navi_cdr(scm_args), scm_env);
+	struct navi_port *p = get_output_port(scm_nr_args-1, scm_argv+1, scm_env);
 	navi_port_write(p, scm_arg1, scm_env);
 	return navi_unspecified();
 }
 
 DEFUN(newline, "newline", 0, NAVI_PROC_VARIADIC)
 {
-	struct navi_port *p = get_output_port(scm_args, scm_env);
+	struct navi_port *p = get_output_port(scm_nr_args, scm_argv, scm_env);
 	navi_port_write_char('\n', p, scm_env);
 	return navi_unspecified();
 }
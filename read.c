@@ -266,11 +266,18 @@ static navi_obj read_string(struct navi_port *port, navi_env env)
 static inline navi_obj read_symbol(struct navi_port *port, int (*stop)(int,navi_env),
 		navi_env env)
 {
+	size_t i;
+	uint32_t hash = NAVI_SYMBOL_HASH_INIT;
 	char *str = read_until(port, stop, env);
 
-	for (unsigned i = 0; str[i] != '\0'; i++)
+	// fold case and hash in one pass, so interning doesn't rescan
+	for (i = 0; str[i] != '\0'; i++) {
 		str[i] = handle_case(port, str[i]);
-	return navi_make_symbol(str);
+		hash = navi_symbol_hash_step(hash, str[i]);
+	}
+	navi_obj symbol = navi_intern(str, i, hash);
+	free(str);
+	return symbol;
 }
 
 static navi_obj read_symbol_with_prefix(struct navi_port *port,
@@ -284,8 +291,11 @@ static navi_obj read_symbol_with_prefix(struct navi_port *port,
 	prefixed[0] = first;
 	for (size_t i = 0; i < length+1; i++)
 		prefixed[i+1] = handle_case(port, unfixed[i]);
+	free(unfixed);
 
-	return navi_make_symbol(prefixed);
+	navi_obj symbol = navi_make_symbol(prefixed);
+	free(prefixed);
+	return symbol;
 }
 
 static const struct {
@@ -369,7 +379,7 @@ static void consume_line(struct navi_port *port, navi_env env)
 static navi_obj read_list(struct navi_port *port, navi_env env)
 {
 	struct navi_pair head, *elmptr = &head;
-	struct navi_guard *guard = NULL;
+	size_t guard = navi_gc_roots();
 	for (;;) {
 		navi_obj expr;
 		char c = ipeek_first_char(port, env);
@@ -390,7 +400,7 @@ static navi_obj read_list(struct navi_port *port, navi_env env)
 			if (unlikely((c = peek_first_char(port, env)) != ')'))
 				navi_read_error(env, "missing list terminator");
 			read_char(port, env);
-			return head.cdr;
+			goto end;
 		case '#':
 			read_char(port, env);
 			if (navi_type((expr = read_sharp(port, env))) == NAVI_VOID)
@@ -403,8 +413,8 @@ static navi_obj read_list(struct navi_port *port, navi_env env)
 			expr = navi_iread(port, env);
 		}
 		elmptr->cdr = navi_make_empty_pair();
-		if (!guard)
-			guard = navi_gc_guard(elmptr->cdr, env);
+		if (elmptr == &head)
+			navi_gc_guard(elmptr->cdr);
 		elmptr = navi_pair(elmptr->cdr);
 		elmptr->car = expr;
 	}
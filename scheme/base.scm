@@ -62,7 +62,7 @@
     ;write-bytevector write-string
     write-char write-u8
 
-    ;string->symbol symbol->string symbol=? symbol?
+    string->symbol symbol->string ;symbol=? symbol?
     eof-object eof-object?
     ;procedure?
 
@@ -246,7 +246,7 @@
     (define string ##string)
     (define string->list ##string->list)
     (define string->number ##string->number)
-    ;(define string->symbol ##string->symbol)
+    (define string->symbol ##string->symbol)
     (define string->utf8 ##string->utf8)
     (define string->vector ##string->vector)
     (define string-append ##string-append)
@@ -263,7 +263,7 @@
     (define string>? ##string>?)
     (define string? ##string?)
     (define substring ##substring)
-    ;(define symbol->string ##symbol->string)
+    (define symbol->string ##symbol->string)
     ;(define symbol=? ##symbol=?)
     ;(define symbol? ##symbol?)
     ;(define syntax-error ##syntax-error)
@@ -13,58 +13,99 @@
  * allocated.
  *
  * This allocator reduces fragmentation and speeds up alloc/free.
+ *
+ * Each thread keeps a "magazine" for every cache, and allocates from it
+ * without locking.  Only when a magazine runs empty (or, for frees, overflows)
+ * does the thread take the cache's lock to go to the slab lists (the "depot").
+ *
+ * For ordinary caches, a magazine is an array of free objects: a refill moves
+ * a batch of objects out of the slabs, and frees go into the array until it
+ * overflows and half of it is flushed back.  Objects in a magazine are
+ * counted as in use by their slab.
+ *
+ * Caches whose objects are swept by the collector (NAVI_SLAB_SWEPT) keep a
+ * bitmap of the allocated objects in each slab, which is too fine-grained to
+ * share between threads without atomic updates.  So instead, the magazine is
+ * a whole slab which the thread owns and allocates from until it's full.
+ * Owned slabs aren't on the depot's lists, and only their owner allocates
+ * from them.  Objects in these caches are only freed by sweeping, and the
+ * collector must not run while other threads allocate from the caches it
+ * sweeps.
  */
 
+#include <sys/mman.h>
+#include <unistd.h>
 #include "slab.h"
 
-#define SLAB_SIZE 4096
 #define SLAB_DESC_SIZE offsetof(struct slab, mem)
 #define SLAB_MEM_SIZE (SLAB_SIZE - SLAB_DESC_SIZE)
 
-#define slab_entry(n) rb_entry(n, struct slab, node)
-
-/*
- * Some objects that use the slab allocator have NAVI_SLIST_ENTRYs, while
- * other's have NAVI_LIST_ENTRYs -- but all of them have their link(s)
- * as the first member of their struct.
- *
- * We're playing fast and loose with pointers here, and probably breaking the
- * strict aliasing rule.  Let's hope the compiler doesn't do some crazy LTO
- * and break this.
- */
+/* each VM has a dozen caches */
+#define SLAB_MAX_CACHES 1024
+#define MAGAZINE_SIZE 32
+/* number of objects moved between a magazine and the depot at once */
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
 
-struct slab_slist_entry {
-	NAVI_SLIST_ENTRY(slab_slist_entry) link;
-	unsigned char data[];
+struct magazine {
+	/* the owned slab, for NAVI_SLAB_SWEPT caches */
+	struct slab *slab;
+	unsigned int nr;
+	void *objs[MAGAZINE_SIZE];
 };
 
-struct slab_list_entry {
-	NAVI_LIST_ENTRY(slab_list_entry) link;
-	unsigned char data[];
-};
+/* allocated when the thread first uses the cache */
+static _Thread_local struct magazine *magazines[SLAB_MAX_CACHES];
 
-struct slab {
-	struct rb_node node;
-	union {
-		NAVI_SLIST_HEAD(slab_slist_head, slab_slist_entry) free;
-		NAVI_LIST_HEAD(slab_list_head, slab_list_entry) _free;
-	};
-	unsigned int in_use;
-	unsigned long mem[];
-};
+/* protects the cache registry and the released slabs */
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct slab_cache *caches[SLAB_MAX_CACHES];
+static unsigned int nr_caches;
+
+/* Round @size up to a power of two, and at least SLAB_SIZE. */
+static size_t arena_size(size_t size)
+{
+	size_t arena = SLAB_SIZE;
+	while (arena < size)
+		arena *= 2;
+	return arena;
+}
 
-struct slab_cache *navi_slab_cache_create(size_t size, unsigned int flags)
+/*
+ * Create a slab cache for objects of @size bytes.  Slabs are carved out of
+ * arenas of @arena bytes (SLAB_ARENA_SIZE if 0), rounded up to a power of two.
+ */
+struct slab_cache *navi_slab_cache_create(size_t size, unsigned int flags,
+		size_t arena)
 {
 	struct slab_cache *cache = navi_critical_malloc(sizeof(struct slab_cache));
 
-	cache->full    = (struct rb_tree) RB_ROOT_INIT;
-	cache->partial = (struct rb_tree) RB_ROOT_INIT;
-	cache->empty   = (struct rb_tree) RB_ROOT_INIT;
+	NAVI_LIST_INIT(&cache->partial);
+	NAVI_LIST_INIT(&cache->empty);
+	cache->slabs   = NULL;
+	cache->fresh   = NULL;
+	cache->nr_empty = 0;
+	cache->arena.size = arena_size(arena ? arena : SLAB_ARENA_SIZE);
+	cache->arena.next = 0;
+	cache->arena.end  = 0;
+	pthread_mutex_init(&cache->lock, NULL);
 
 	cache->flags = flags;
+	size = (size + SLAB_GRANULE - 1) & ~(size_t)(SLAB_GRANULE - 1);
 	cache->obj_size = (size < 16) ? 16 : size;
 	cache->objs_per_slab = SLAB_MEM_SIZE / cache->obj_size;
 
+	// reuse the id of a destroyed cache, if there is one
+	pthread_mutex_lock(&slab_lock);
+	for (cache->id = 0; cache->id < nr_caches; cache->id++) {
+		if (!caches[cache->id])
+			break;
+	}
+	if (cache->id == SLAB_MAX_CACHES)
+		navi_die("too many slab caches");
+	if (cache->id == nr_caches)
+		nr_caches++;
+	caches[cache->id] = cache;
+	pthread_mutex_unlock(&slab_lock);
 	return cache;
 }
 
@@ -91,10 +132,67 @@ static void init_double(struct slab_cache *cache, struct slab *slab)
 	}
 }
 
+/*
+ * Slabs whose memory has been given back to the OS by navi_slab_shrink.  The
+ * addresses are kept here rather than in the slabs themselves, so that the
+ * pages aren't faulted back in until they're reused.
+ */
+static struct {
+	void **slabs;
+	size_t nr;
+	size_t size;
+} released;
+
+/*
+ * Slabs must be aligned to SLAB_SIZE.  Allocating them one at a time with
+ * aligned_alloc wastes nearly as much memory as it returns, so each cache
+ * carves its slabs out of larger, naturally aligned arenas instead.  Arenas
+ * of HUGE_PAGE_SIZE or more are advised to be backed by huge pages, so that
+ * a heap of many slabs doesn't need a TLB entry for every one of them.
+ */
+static void new_arena(struct slab_cache *cache)
+{
+	void *mem = aligned_alloc(cache->arena.size, cache->arena.size);
+	if (!mem)
+		navi_die("not enough memory");
+#ifdef MADV_HUGEPAGE
+	if (cache->arena.size >= HUGE_PAGE_SIZE)
+		madvise(mem, cache->arena.size, MADV_HUGEPAGE);
+#endif
+	cache->arena.next = (uintptr_t) mem;
+	cache->arena.end = cache->arena.next + cache->arena.size;
+}
+
+static void *alloc_slab_memory(struct slab_cache *cache)
+{
+	void *mem = NULL;
+	pthread_mutex_lock(&slab_lock);
+	if (released.nr)
+		mem = released.slabs[--released.nr];
+	pthread_mutex_unlock(&slab_lock);
+	if (mem)
+		return mem;
+	if (cache->arena.next == cache->arena.end)
+		new_arena(cache);
+	cache->arena.next += SLAB_SIZE;
+	return (void*) (cache->arena.next - SLAB_SIZE);
+}
+
+/*
+ * Set the size of the arenas which @cache carves slabs out of.  The current
+ * arena is used up first.
+ */
+void navi_slab_set_arena_size(struct slab_cache *cache, size_t size)
+{
+	cache->arena.size = arena_size(size);
+}
+
 /* Allocates and initializes a new slab for the given cache */
 static struct slab *new_slab(struct slab_cache *cache)
 {
-	struct slab *slab = navi_critical_malloc(SLAB_SIZE);
+	struct slab *slab = alloc_slab_memory(cache);
+	memset(slab->used, 0, sizeof(slab->used));
+	memset(slab->marks, 0, sizeof(slab->marks));
 
 	if (cache->flags & NAVI_SLAB_DOUBLY_LINKED)
 		init_double(cache, slab);
@@ -102,45 +200,69 @@ static struct slab *new_slab(struct slab_cache *cache)
 		init_single(cache, slab);
 
 	slab->in_use = 0;
+	slab->fresh = false;
+	slab->owned = false;
+	slab->next = cache->slabs;
+	cache->slabs = slab;
 	return slab;
 }
 
-static void slab_insert(struct rb_tree *tree, struct slab *slab)
+/*
+ * Partial and empty slabs are kept on lists in the cache, so that objects
+ * can be allocated from them.  Full slabs and owned slabs aren't on any list.
+ */
+static inline struct slab_head *state_list(struct slab_cache *cache,
+		struct slab *slab, unsigned in_use)
 {
-	struct slab *ptr;
-	struct rb_node **p = rb_root_link(tree);
-	struct rb_node *parent = rb_root_parent(tree);
-
-	while (*p) {
-		parent = *p;
-		ptr = rb_entry(parent, struct slab, node);
+	if (slab->owned)
+		return NULL;
+	if (in_use == 0)
+		return &cache->empty;
+	if (in_use == cache->objs_per_slab)
+		return NULL;
+	return &cache->partial;
+}
 
-		if (slab < ptr)
-			p = &(*p)->left;
-		else
-			p = &(*p)->right;
-	}
+static inline void slab_list_insert(struct slab_cache *cache,
+		struct slab_head *head, struct slab *slab)
+{
+	NAVI_LIST_INSERT_HEAD(head, slab, link);
+	if (head == &cache->empty)
+		cache->nr_empty++;
+}
 
-	navi_rb_insert(&slab->node, parent, p);
+static inline void slab_list_remove(struct slab_cache *cache,
+		struct slab_head *head, struct slab *slab)
+{
+	NAVI_LIST_REMOVE(slab, link);
+	if (head == &cache->empty)
+		cache->nr_empty--;
 }
 
-static inline void slab_remove(struct slab *slab)
+/* Move @slab to the right list after its use count changed from @was. */
+static inline void slab_update(struct slab_cache *cache, struct slab *slab,
+		unsigned was)
 {
-	navi_rb_remove(&slab->node);
+	struct slab_head *from = state_list(cache, slab, was);
+	struct slab_head *to = state_list(cache, slab, slab->in_use);
+	if (from == to)
+		return;
+	if (from)
+		slab_list_remove(cache, from, slab);
+	if (to)
+		slab_list_insert(cache, to, slab);
 }
 
 static struct slab *get_slab(struct slab_cache *cache)
 {
 	struct slab *slab;
-	if (rb_empty(&cache->partial) && rb_empty(&cache->empty)) {
-		slab = new_slab(cache);
-		slab_insert(&cache->partial, slab);
-		return slab;
-	}
-
-	if (rb_empty(&cache->partial))
-		return slab_entry(rb_root(&cache->empty));
-	return slab_entry(rb_root(&cache->partial));
+	if (!NAVI_LIST_EMPTY(&cache->partial))
+		return NAVI_LIST_FIRST(&cache->partial);
+	if (!NAVI_LIST_EMPTY(&cache->empty))
+		return NAVI_LIST_FIRST(&cache->empty);
+	slab = new_slab(cache);
+	slab_list_insert(cache, &cache->empty, slab);
+	return slab;
 }
 
 static void *slab_pop(struct slab_cache *cache, struct slab *slab)
@@ -155,78 +277,338 @@ static void *slab_pop(struct slab_cache *cache, struct slab *slab)
 	return obj;
 }
 
-__hot void *navi_slab_alloc(struct slab_cache *cache)
+static void slab_push(struct slab_cache *cache, struct slab *slab, void *mem)
+{
+	if (cache->flags & NAVI_SLAB_DOUBLY_LINKED) {
+		struct slab_list_entry *obj = mem;
+		NAVI_LIST_INSERT_HEAD(&slab->_free, obj, link);
+	} else {
+		struct slab_slist_entry *obj = mem;
+		NAVI_SLIST_INSERT_HEAD(&slab->free, obj, link);
+	}
+}
+
+static inline void set_used(struct slab *slab, void *mem)
+{
+	unsigned i = navi_slab_index(slab, mem);
+	slab->used[i / SLAB_MAP_BITS] |= 1UL << (i % SLAB_MAP_BITS);
+}
+
+/* Fill @mag with a batch of objects from the depot. */
+static void refill(struct slab_cache *cache, struct magazine *mag)
+{
+	pthread_mutex_lock(&cache->lock);
+	// the first object popped is the first to be allocated
+	for (unsigned i = MAGAZINE_BATCH; i-- > 0;) {
+		struct slab *slab = get_slab(cache);
+		mag->objs[i] = slab_pop(cache, slab);
+		slab->in_use++;
+		slab_update(cache, slab, slab->in_use - 1);
+	}
+	mag->nr = MAGAZINE_BATCH;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Return the @nr least recently freed objects in @mag to the depot. */
+static void flush(struct slab_cache *cache, struct magazine *mag, unsigned nr)
+{
+	pthread_mutex_lock(&cache->lock);
+	for (unsigned i = 0; i < nr; i++) {
+		struct slab *slab = navi_slab_of(mag->objs[i]);
+		slab_push(cache, slab, mag->objs[i]);
+		slab->in_use--;
+		slab_update(cache, slab, slab->in_use + 1);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	mag->nr -= nr;
+	memmove(mag->objs, mag->objs + nr, mag->nr * sizeof(void*));
+}
+
+/* Give the slab owned by @mag back to the depot.  Call with the lock held. */
+static void disown(struct slab_cache *cache, struct magazine *mag)
+{
+	struct slab *slab = mag->slab;
+	struct slab_head *head;
+	slab->owned = false;
+	if ((head = state_list(cache, slab, slab->in_use)))
+		slab_list_insert(cache, head, slab);
+	mag->slab = NULL;
+}
+
+/* Swap the slab owned by @mag (if any) for one with free objects. */
+static struct slab *own(struct slab_cache *cache, struct magazine *mag)
 {
+	pthread_mutex_lock(&cache->lock);
+	if (mag->slab)
+		disown(cache, mag);
 	struct slab *slab = get_slab(cache);
+	slab_list_remove(cache, state_list(cache, slab, slab->in_use), slab);
+	slab->owned = true;
+	mag->slab = slab;
+	pthread_mutex_unlock(&cache->lock);
+	return slab;
+}
+
+/* Put @slab on the fresh list of @cache. */
+static void make_fresh(struct slab_cache *cache, struct slab *slab)
+{
+	pthread_mutex_lock(&cache->lock);
+	slab->fresh = true;
+	slab->next_fresh = cache->fresh;
+	cache->fresh = slab;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+static inline void *alloc_swept(struct slab_cache *cache, struct magazine *mag)
+{
+	struct slab *slab = mag->slab;
+	if (unlikely(!slab || slab->in_use == cache->objs_per_slab))
+		slab = own(cache, mag);
+
 	void *obj = slab_pop(cache, slab);
+	set_used(slab, obj);
+	slab->in_use++;
+	if (unlikely(!slab->fresh))
+		make_fresh(cache, slab);
+	return obj;
+}
+
+static struct magazine *new_magazine(struct slab_cache *cache)
+{
+	struct magazine *mag = navi_critical_malloc(sizeof(struct magazine));
+	mag->slab = NULL;
+	mag->nr = 0;
+	magazines[cache->id] = mag;
+	return mag;
+}
+
+__hot void *navi_slab_alloc(struct slab_cache *cache)
+{
+	struct magazine *mag = magazines[cache->id];
+	if (unlikely(!mag))
+		mag = new_magazine(cache);
+	if (cache->flags & NAVI_SLAB_SWEPT)
+		return alloc_swept(cache, mag);
+	if (unlikely(!mag->nr))
+		refill(cache, mag);
+	return mag->objs[--mag->nr];
+}
+
+/* Free an object.  Objects in NAVI_SLAB_SWEPT caches are freed by sweeping. */
+void __hot navi_slab_free(struct slab_cache *cache, void *mem)
+{
+	struct magazine *mag = magazines[cache->id];
+	assert(!(cache->flags & NAVI_SLAB_SWEPT));
+	if (unlikely(!mag))
+		mag = new_magazine(cache);
+	if (unlikely(mag->nr == MAGAZINE_SIZE))
+		flush(cache, mag, MAGAZINE_BATCH);
+	mag->objs[mag->nr++] = mem;
+}
 
-	// move slab to full/partial list, as appropriate
-	if (++slab->in_use == cache->objs_per_slab) {
-		slab_remove(slab);
-		slab_insert(&cache->full, slab);
-	} else if (slab->in_use == 1) {
-		slab_remove(slab);
-		slab_insert(&cache->partial, slab);
+/*
+ * Give the calling thread's magazines back to the depot.  Threads which
+ * allocate from slab caches should call this before exiting.
+ */
+void navi_slab_flush(void)
+{
+	pthread_mutex_lock(&slab_lock);
+	unsigned nr = nr_caches;
+	pthread_mutex_unlock(&slab_lock);
+	for (unsigned i = 0; i < nr; i++) {
+		struct magazine *mag = magazines[i];
+		if (!mag)
+			continue;
+		if (mag->nr)
+			flush(caches[i], mag, mag->nr);
+		if (mag->slab) {
+			pthread_mutex_lock(&caches[i]->lock);
+			disown(caches[i], mag);
+			pthread_mutex_unlock(&caches[i]->lock);
+		}
+		free(mag);
+		magazines[i] = NULL;
 	}
-	return obj;
 }
 
-static inline __const void *slab_end(struct slab *slab)
+/* Clear the mark bits of every slab in @cache. */
+void navi_slab_clear_marks(struct slab_cache *cache)
 {
-	return (void*) ((uintptr_t)slab->mem + SLAB_MEM_SIZE);
+	for (struct slab *slab = cache->slabs; slab; slab = slab->next)
+		memset(slab->marks, 0, sizeof(slab->marks));
 }
 
-static __hot struct slab *_find_slab(struct rb_tree *tree, void *mem)
+#ifdef __GNUC__
+#define lowest_bit(word) __builtin_ctzl(word)
+#else
+static inline unsigned lowest_bit(unsigned long word)
 {
-	struct rb_node *n = rb_root(tree);
-	while (n) {
-		struct slab *slab = slab_entry(n);
-		if (mem < (void*)slab)
-			n = n->left;
-		else if (mem >= slab_end(slab))
-			n = n->right;
-		else
-			return slab;
+	unsigned i = 0;
+	while (!(word & 1)) {
+		word >>= 1;
+		i++;
 	}
-	return NULL;
+	return i;
 }
+#endif
 
-static __hot struct slab *find_slab(struct slab_cache *cache, void *mem)
+static inline void *granule(struct slab *slab, unsigned word, unsigned bit)
 {
-	struct slab *slab;
-	if ((slab = _find_slab(&cache->full, mem)))
-		return slab;
-	if ((slab = _find_slab(&cache->partial, mem)))
-		return slab;
-	return NULL;
+	return (void*) ((uintptr_t)slab->mem
+			+ (word * SLAB_MAP_BITS + bit) * SLAB_GRANULE);
 }
 
-void __hot navi_slab_free(struct slab_cache *cache, void *mem)
+static unsigned sweep(struct slab_cache *cache, struct slab *slab,
+		bool (*dead)(void *mem), bool skip_marked)
 {
-	struct slab *slab;
-	if (!(slab = find_slab(cache, mem)))
-		navi_die("slab_free: failed to locate slab!\n");
+	unsigned freed = 0;
+	for (unsigned w = 0; w < SLAB_MAP_WORDS; w++) {
+		unsigned long candidates = slab->used[w];
+		if (skip_marked)
+			candidates &= ~slab->marks[w];
+		while (candidates) {
+			unsigned bit = lowest_bit(candidates);
+			candidates &= candidates - 1;
+			void *mem = granule(slab, w, bit);
+			if (!dead(mem))
+				continue;
+			slab->used[w] &= ~(1UL << bit);
+			slab_push(cache, slab, mem);
+			freed++;
+		}
+	}
+	if (!freed)
+		return 0;
 
-	if (cache->flags & NAVI_SLAB_DOUBLY_LINKED) {
-		struct slab_list_entry *obj = mem;
-		NAVI_LIST_INSERT_HEAD(&slab->_free, obj, link);
-	} else {
-		struct slab_slist_entry *obj = mem;
-		NAVI_SLIST_INSERT_HEAD(&slab->free, obj, link);
+	slab->in_use -= freed;
+	slab_update(cache, slab, slab->in_use + freed);
+	return freed;
+}
+
+/*
+ * Sweep a slab: calls @dead for each allocated object which isn't marked,
+ * and frees the object if it returns true.  Returns the number of objects
+ * freed.  The bitmaps are scanned a word at a time, so marked objects and
+ * free memory are skipped without being touched.
+ */
+unsigned navi_slab_sweep(struct slab_cache *cache, struct slab *slab,
+		bool (*dead)(void *mem))
+{
+	pthread_mutex_lock(&cache->lock);
+	unsigned freed = sweep(cache, slab, dead, true);
+	pthread_mutex_unlock(&cache->lock);
+	return freed;
+}
+
+/*
+ * Sweep the slabs which have been allocated from since the last call: calls
+ * @dead for each allocated object in them, marked or not, and frees the
+ * object if it returns true.  @dead must not allocate from @cache.
+ */
+void navi_slab_sweep_fresh(struct slab_cache *cache, bool (*dead)(void *mem))
+{
+	pthread_mutex_lock(&cache->lock);
+	struct slab *slab = cache->fresh;
+	cache->fresh = NULL;
+	for (; slab; slab = slab->next_fresh) {
+		slab->fresh = false;
+		sweep(cache, slab, dead, false);
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Call @fn for each allocated object in @cache. */
+void navi_slab_for_each(struct slab_cache *cache,
+		void (*fn)(void *mem, void *data), void *data)
+{
+	for (struct slab *slab = cache->slabs; slab; slab = slab->next) {
+		for (unsigned w = 0; w < SLAB_MAP_WORDS; w++) {
+			unsigned long used = slab->used[w];
+			while (used) {
+				unsigned bit = lowest_bit(used);
+				used &= used - 1;
+				fn(granule(slab, w, bit), data);
+			}
+		}
 	}
+}
 
-	// update slab status within cache
-	if (--slab->in_use == 0) {
-		slab_remove(slab);
-		slab_insert(&cache->empty, slab);
-	} else if (slab->in_use + 1 == cache->objs_per_slab) {
-		slab_remove(slab);
-		slab_insert(&cache->partial, slab);
+static bool release_slab_memory(struct slab *slab)
+{
+	bool ok = false;
+	long page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0 || SLAB_SIZE % page_size)
+		return false;
+	pthread_mutex_lock(&slab_lock);
+	if (released.nr == released.size) {
+		size_t size = released.size ? released.size * 2 : 64;
+		void **slabs = realloc(released.slabs, size * sizeof(void*));
+		if (!slabs)
+			goto out;
+		released.slabs = slabs;
+		released.size = size;
 	}
+	if (madvise(slab, SLAB_SIZE, MADV_DONTNEED))
+		goto out;
+	released.slabs[released.nr++] = slab;
+	ok = true;
+out:
+	pthread_mutex_unlock(&slab_lock);
+	return ok;
 }
 
 /*
- * TODO: navi_slab_shrink(struct slab_cache *cache)
+ * Give the memory of all but @keep of the empty slabs in @cache back to the
+ * OS.  The released slabs are removed from the cache; their addresses are
+ * reused for new slabs later.  Returns the number of slabs released.
  *
- * Function to try reclaiming memory from a slab cache.
+ * Slabs on the fresh list are left alone, and this must not be called while
+ * a sweep is walking the cache's slabs.
+ */
+unsigned navi_slab_shrink(struct slab_cache *cache, unsigned keep)
+{
+	unsigned nr = 0;
+	pthread_mutex_lock(&cache->lock);
+	for (struct slab **p = &cache->slabs; *p && cache->nr_empty > keep;) {
+		struct slab *slab = *p;
+		if (slab->in_use || slab->fresh || slab->owned) {
+			p = &slab->next;
+			continue;
+		}
+		*p = slab->next;
+		slab_list_remove(cache, &cache->empty, slab);
+		if (!release_slab_memory(slab)) {
+			// couldn't release it: keep it after all
+			slab_list_insert(cache, &cache->empty, slab);
+			*p = slab;
+			break;
+		}
+		nr++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return nr;
+}
+
+/*
+ * Destroy @cache.  Its slabs, and the rest of its arena, are given back to
+ * the OS, and their addresses are reused by other caches.  No thread but the
+ * caller may have objects from the cache in its magazines.
  */
+void navi_slab_cache_destroy(struct slab_cache *cache)
+{
+	free(magazines[cache->id]);
+	magazines[cache->id] = NULL;
+	pthread_mutex_lock(&slab_lock);
+	caches[cache->id] = NULL;
+	pthread_mutex_unlock(&slab_lock);
+
+	for (struct slab *slab = cache->slabs, *next; slab; slab = next) {
+		next = slab->next;
+		release_slab_memory(slab);
+	}
+	for (; cache->arena.next < cache->arena.end;
+			cache->arena.next += SLAB_SIZE)
+		release_slab_memory((struct slab*) cache->arena.next);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
@@ -8,25 +8,142 @@
 #ifndef _NAVI_SLAB_H_
 #define _NAVI_SLAB_H_
 
-#include "rbtree.h"
+#include <pthread.h>
 
 enum {
 	NAVI_SLAB_DOUBLY_LINKED,
+	/* objects are swept by the collector: keep the used bitmap and the
+	 * fresh list up to date */
+	NAVI_SLAB_SWEPT = 2,
 };
 
-struct slab;
+/*
+ * Some objects that use the slab allocator have NAVI_SLIST_ENTRYs, while
+ * other's have NAVI_LIST_ENTRYs -- but all of them have their link(s)
+ * as the first member of their struct.
+ *
+ * We're playing fast and loose with pointers here, and probably breaking the
+ * strict aliasing rule.  Let's hope the compiler doesn't do some crazy LTO
+ * and break this.
+ */
+
+struct slab_slist_entry {
+	NAVI_SLIST_ENTRY(slab_slist_entry) link;
+	unsigned char data[];
+};
+
+struct slab_list_entry {
+	NAVI_LIST_ENTRY(slab_list_entry) link;
+	unsigned char data[];
+};
+
+#define SLAB_SIZE 4096
+
+/* default size of the arenas slabs are carved out of */
+#define SLAB_ARENA_SIZE (SLAB_SIZE * 32)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/*
+ * Each slab has two bitmaps, with one bit per SLAB_GRANULE bytes of memory:
+ * one for the objects which are allocated, and one for the garbage
+ * collector's marks.  Object sizes are rounded up to a multiple of
+ * SLAB_GRANULE, so every object starts on a bit of its own.  Keeping the bits in the slab header means
+ * that marking and sweeping don't have to touch the objects themselves.
+ */
+#define SLAB_GRANULE 8
+#define SLAB_MAP_BITS (8 * sizeof(unsigned long))
+#define SLAB_MAP_WORDS (SLAB_SIZE / SLAB_GRANULE / SLAB_MAP_BITS)
+
+struct slab {
+	NAVI_LIST_ENTRY(slab) link;
+	union {
+		NAVI_SLIST_HEAD(slab_slist_head, slab_slist_entry) free;
+		NAVI_LIST_HEAD(slab_list_head, slab_list_entry) _free;
+	};
+	/* the next slab in the cache, in order of creation (newest first) */
+	struct slab *next;
+	/* the next slab allocated from since the last navi_slab_sweep_fresh */
+	struct slab *next_fresh;
+	bool fresh;
+	/* owned by a thread's magazine (see slab.c) */
+	bool owned;
+	unsigned int in_use;
+	unsigned long used[SLAB_MAP_WORDS];
+	unsigned long marks[SLAB_MAP_WORDS];
+	unsigned long mem[];
+};
+
+NAVI_LIST_HEAD(slab_head, slab);
 
 struct slab_cache {
-	struct rb_tree full;
-	struct rb_tree partial;
-	struct rb_tree empty;
+	/* protects everything but the mark bits */
+	pthread_mutex_t lock;
+	struct slab_head partial;
+	struct slab_head empty;
+	struct slab *slabs;
+	struct slab *fresh;
 	unsigned int flags;
 	unsigned int objs_per_slab;
+	/* the number of slabs on the empty list */
+	unsigned int nr_empty;
 	size_t obj_size;
+	/* index of the cache's magazine in each thread */
+	unsigned int id;
+	/* the arena new slabs are carved out of */
+	struct {
+		size_t size;
+		uintptr_t next;
+		uintptr_t end;
+	} arena;
 };
 
-struct slab_cache *navi_slab_cache_create(size_t size, unsigned int flags);
+struct slab_cache *navi_slab_cache_create(size_t size, unsigned int flags,
+		size_t arena);
+void navi_slab_cache_destroy(struct slab_cache *cache);
+void navi_slab_set_arena_size(struct slab_cache *cache, size_t size);
 void *navi_slab_alloc(struct slab_cache *cache);
 void navi_slab_free(struct slab_cache *cache, void *mem);
+void navi_slab_flush(void);
+void navi_slab_clear_marks(struct slab_cache *cache);
+unsigned navi_slab_sweep(struct slab_cache *cache, struct slab *slab,
+		bool (*dead)(void *mem));
+void navi_slab_sweep_fresh(struct slab_cache *cache, bool (*dead)(void *mem));
+void navi_slab_for_each(struct slab_cache *cache,
+		void (*fn)(void *mem, void *data), void *data);
+unsigned navi_slab_shrink(struct slab_cache *cache, unsigned keep);
+
+/* Slabs are aligned to SLAB_SIZE, so the slab containing @mem is found by
+ * masking the address. */
+static inline __const struct slab *navi_slab_of(const void *mem)
+{
+	return (struct slab*) ((uintptr_t)mem & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+static inline __const unsigned navi_slab_index(struct slab *slab,
+		const void *mem)
+{
+	return ((uintptr_t)mem - (uintptr_t)slab->mem) / SLAB_GRANULE;
+}
+
+static inline bool navi_slab_is_marked(const void *mem)
+{
+	struct slab *slab = navi_slab_of(mem);
+	unsigned i = navi_slab_index(slab, mem);
+	return slab->marks[i / SLAB_MAP_BITS] & (1UL << (i % SLAB_MAP_BITS));
+}
+
+static inline void navi_slab_set_mark(const void *mem)
+{
+	struct slab *slab = navi_slab_of(mem);
+	unsigned i = navi_slab_index(slab, mem);
+	slab->marks[i / SLAB_MAP_BITS] |= 1UL << (i % SLAB_MAP_BITS);
+}
+
+static inline void navi_slab_clear_mark(const void *mem)
+{
+	struct slab *slab = navi_slab_of(mem);
+	unsigned i = navi_slab_index(slab, mem);
+	slab->marks[i / SLAB_MAP_BITS] &= ~(1UL << (i % SLAB_MAP_BITS));
+}
 
 #endif
@@ -244,11 +244,10 @@ static int navi_strcoll(struct navi_string *a, struct navi_string *b, bool ci)
 #define STRING_COMPARE(cname, scmname, op, ci) \
 	DEFUN(cname, scmname, 2, NAVI_PROC_VARIADIC, NAVI_STRING, NAVI_STRING) \
 	{ \
-		navi_obj cons; \
 		struct navi_string *fst, *snd; \
 		fst = navi_string(scm_arg1); \
-		navi_list_for_each(cons, navi_cdr(scm_args)) { \
-			snd = navi_string_cast(navi_car(cons), scm_env); \
+		for (unsigned i = 1; i < scm_nr_args; i++) { \
+			snd = navi_string_cast(scm_argv[i], scm_env); \
 			if (!(navi_strcoll(fst, snd, ci) op 0)) \
 				return navi_make_bool(false); \
 		} \
@@ -322,13 +321,13 @@ STRING_CASEMAP(string_foldcase, "string-foldcase", tolower)
 
 DEFUN(string_append, "string-append", 0, NAVI_PROC_VARIADIC)
 {
-	navi_obj cons, obj;
+	navi_obj obj;
 	struct navi_string *str;
 	int32_t i = 0, size = 0, length = 0;
 
 	// count combined size/length
-	navi_list_for_each(cons, scm_args) {
-		str = navi_string_cast(navi_car(cons), scm_env);
+	for (unsigned k = 0; k < scm_nr_args; k++) {
+		str = navi_string_cast(scm_argv[k], scm_env);
 		size += str->size;
 		length += str->length;
 	}
@@ -338,8 +337,8 @@ DEFUN(string_append, "string-append", 0, NAVI_PROC_VARIADIC)
 	str = navi_string(obj);
 
 	// copy
-	navi_list_for_each(cons, scm_args) {
-		struct navi_string *other = navi_string(navi_car(cons));
+	for (unsigned k = 0; k < scm_nr_args; k++) {
+		struct navi_string *other = navi_string(scm_argv[k]);
 		for (int32_t j = 0; j < other->size; j++)
 			str->data[i++] = other->data[j];
 	}
@@ -474,5 +473,17 @@ DEFUN(string_copy_to, "string-copy!", 3, NAVI_PROC_VARIADIC,
 
 DEFUN(substring, "substring", 3, 0, NAVI_STRING, NAVI_FIXNUM, NAVI_FIXNUM)
 {
-	return scm_string_copy(3, scm_args, scm_env, NULL);
+	return scm_argv_string_copy(3, scm_argv, scm_list, scm_env, NULL);
+}
+
+DEFUN(string_to_symbol, "string->symbol", 1, 0, NAVI_STRING)
+{
+	struct navi_string *str = navi_string(scm_arg1);
+	const char *data = (const char*) str->data;
+	return navi_intern(data, str->size, navi_symbol_hash(data, str->size));
+}
+
+DEFUN(symbol_to_string, "symbol->string", 1, 0, NAVI_SYMBOL)
+{
+	return navi_cstr_to_string(navi_symbol(scm_arg1)->data);
 }
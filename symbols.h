@@ -8,36 +8,69 @@
 #ifndef _NAVI_SYMBOLS_H
 #define _NAVI_SYMBOLS_H
 
-/* automatically interned symbols */
-extern navi_obj navi_sym_begin;
-extern navi_obj navi_sym_quote;
-extern navi_obj navi_sym_quasiquote;
-extern navi_obj navi_sym_unquote;
-extern navi_obj navi_sym_splice;
-extern navi_obj navi_sym_else;
-extern navi_obj navi_sym_eq_lt;
-extern navi_obj navi_sym_lib_paths;
-extern navi_obj navi_sym_command_line;
-extern navi_obj navi_sym_current_exn;
-extern navi_obj navi_sym_current_input;
-extern navi_obj navi_sym_current_output;
-extern navi_obj navi_sym_current_error;
-extern navi_obj navi_sym_read_error;
-extern navi_obj navi_sym_file_error;
-extern navi_obj navi_sym_internal_error;
-extern navi_obj navi_sym_repl;
-extern navi_obj navi_sym_export;
-extern navi_obj navi_sym_import;
-extern navi_obj navi_sym_only;
-extern navi_obj navi_sym_except;
-extern navi_obj navi_sym_prefix;
-extern navi_obj navi_sym_rename;
-extern navi_obj navi_sym_deflib;
-extern navi_obj navi_sym_include;
-extern navi_obj navi_sym_include_ci;
-extern navi_obj navi_sym_include_libdecl;
-extern navi_obj navi_sym_cond_expand;
-extern navi_obj navi_sym_ellipsis;
-extern navi_obj navi_sym_underscore;
+/* automatically interned symbols (each VM has its own; see struct navi_vm) */
+struct navi_symbols {
+	navi_obj sym_begin;
+	navi_obj sym_quote;
+	navi_obj sym_quasiquote;
+	navi_obj sym_unquote;
+	navi_obj sym_splice;
+	navi_obj sym_else;
+	navi_obj sym_eq_lt;
+	navi_obj sym_lib_paths;
+	navi_obj sym_command_line;
+	navi_obj sym_current_exn;
+	navi_obj sym_current_input;
+	navi_obj sym_current_output;
+	navi_obj sym_current_error;
+	navi_obj sym_read_error;
+	navi_obj sym_file_error;
+	navi_obj sym_internal_error;
+	navi_obj sym_repl;
+	navi_obj sym_export;
+	navi_obj sym_import;
+	navi_obj sym_only;
+	navi_obj sym_except;
+	navi_obj sym_prefix;
+	navi_obj sym_rename;
+	navi_obj sym_deflib;
+	navi_obj sym_include;
+	navi_obj sym_include_ci;
+	navi_obj sym_include_libdecl;
+	navi_obj sym_cond_expand;
+	navi_obj sym_ellipsis;
+	navi_obj sym_underscore;
+};
+
+#define navi_sym_begin           (_navi_vm->symbols.sym_begin)
+#define navi_sym_quote           (_navi_vm->symbols.sym_quote)
+#define navi_sym_quasiquote      (_navi_vm->symbols.sym_quasiquote)
+#define navi_sym_unquote         (_navi_vm->symbols.sym_unquote)
+#define navi_sym_splice          (_navi_vm->symbols.sym_splice)
+#define navi_sym_else            (_navi_vm->symbols.sym_else)
+#define navi_sym_eq_lt           (_navi_vm->symbols.sym_eq_lt)
+#define navi_sym_lib_paths       (_navi_vm->symbols.sym_lib_paths)
+#define navi_sym_command_line    (_navi_vm->symbols.sym_command_line)
+#define navi_sym_current_exn     (_navi_vm->symbols.sym_current_exn)
+#define navi_sym_current_input   (_navi_vm->symbols.sym_current_input)
+#define navi_sym_current_output  (_navi_vm->symbols.sym_current_output)
+#define navi_sym_current_error   (_navi_vm->symbols.sym_current_error)
+#define navi_sym_read_error      (_navi_vm->symbols.sym_read_error)
+#define navi_sym_file_error      (_navi_vm->symbols.sym_file_error)
+#define navi_sym_internal_error  (_navi_vm->symbols.sym_internal_error)
+#define navi_sym_repl            (_navi_vm->symbols.sym_repl)
+#define navi_sym_export          (_navi_vm->symbols.sym_export)
+#define navi_sym_import          (_navi_vm->symbols.sym_import)
+#define navi_sym_only            (_navi_vm->symbols.sym_only)
+#define navi_sym_except          (_navi_vm->symbols.sym_except)
+#define navi_sym_prefix          (_navi_vm->symbols.sym_prefix)
+#define navi_sym_rename          (_navi_vm->symbols.sym_rename)
+#define navi_sym_deflib          (_navi_vm->symbols.sym_deflib)
+#define navi_sym_include         (_navi_vm->symbols.sym_include)
+#define navi_sym_include_ci      (_navi_vm->symbols.sym_include_ci)
+#define navi_sym_include_libdecl (_navi_vm->symbols.sym_include_libdecl)
+#define navi_sym_cond_expand     (_navi_vm->symbols.sym_cond_expand)
+#define navi_sym_ellipsis        (_navi_vm->symbols.sym_ellipsis)
+#define navi_sym_underscore      (_navi_vm->symbols.sym_underscore)
 
 #endif
@@ -128,20 +128,19 @@ static int gettime(struct timespec *tp)
 
 DEFUN(current_jiffy, "current-jiffy", 0, 0)
 {
-	static time_t first_second = 0;
 	struct timespec t;
 	if (unlikely(gettime(&t) < 0))
 		navi_error(scm_env, "unable to read system clock");
 
 	// start at (approximately) 0 to increase the range before overflow
-	if (!first_second)
-		first_second = t.tv_sec;
-	t.tv_sec -= first_second;
+	if (!_navi_vm->first_second)
+		_navi_vm->first_second = t.tv_sec;
+	t.tv_sec -= _navi_vm->first_second;
 
 	return navi_make_fixnum(t.tv_sec*1000 + t.tv_nsec/1000000);
 }
 
 DEFUN(jiffies_per_second, "jiffies-per-second", 0, 0)
 {
-	return navi_make_fixnum(100);
+	return navi_make_fixnum(1000);
 }
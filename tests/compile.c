@@ -0,0 +1,242 @@
+/* Copyright 2014-2015 Drew Thoreson
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "test.h"
+
+static const enum navi_engine engines[] = {
+	NAVI_ENGINE_TREE,
+	NAVI_ENGINE_CLOSURE,
+	NAVI_ENGINE_VM,
+};
+
+#define for_each_engine(i) \
+	for (i = 0; i < sizeof(engines)/sizeof(*engines) \
+			&& (navi_set_engine(engines[i]), 1); i++)
+
+static void restore_engine(void)
+{
+	navi_set_engine(NAVI_ENGINE_CLOSURE);
+}
+
+START_TEST(test_tail_call)
+{
+	unsigned i;
+	for_each_engine(i) {
+		assert_num_eq(eval("((lambda () (define (loop n) (if (= n 0) 7 (loop (- n 1)))) (loop 100000)))"), 7);
+		assert_num_eq(eval("((lambda () (define (even? n) (if (= n 0) 1 (odd? (- n 1)))) (define (odd? n) (if (= n 0) 0 (even? (- n 1)))) (even? 10001)))"), 0);
+		assert_num_eq(eval("((lambda () (define (loop n) (cond ((= n 0) 3) (else (let ((m (- n 1))) (loop m))))) (loop 100000)))"), 3);
+	}
+	restore_engine();
+}
+END_TEST
+
+/* every form with a tail position bounces, including macro expansions */
+START_TEST(test_tail_forms)
+{
+	unsigned i;
+	eval("(##defmacro (tail-twice x) (list 'begin x x))");
+	eval("(##defmacro (tail-id x) x)");
+	for_each_engine(i) {
+		assert_num_eq(eval("((lambda () (define (loop n) (and #t (or #f (begin (case n ((0) 5) (else (loop (- n 1)))))))) (loop 100000)))"), 5);
+		assert_num_eq(eval("((lambda () (define n 0) (define (f) (tail-twice (set! n (+ n 1)))) (f) n))"), 2);
+		assert_num_eq(eval("((lambda () (define (loop n) (if (= n 0) 9 (tail-id (loop (- n 1))))) (loop 100000)))"), 9);
+	}
+	restore_engine();
+}
+END_TEST
+
+START_TEST(test_closures)
+{
+	unsigned i;
+	for_each_engine(i) {
+		assert_num_eq(eval("((lambda () (define (adder n) (lambda (x) (+ x n))) ((adder 3) 4)))"), 7);
+		assert_num_eq(eval("((lambda () (define n 0) (define (inc!) (set! n (+ n 1)) n) (inc!) (inc!)))"), 2);
+		assert_num_eq(eval("((lambda (x) (let* ((x (+ x 1)) (y (* x 2))) (let ((x y) (y x)) (- x y)))) 1)"), 2);
+	}
+	restore_engine();
+}
+END_TEST
+
+START_TEST(test_shadowed_syntax)
+{
+	unsigned i;
+	for_each_engine(i) {
+		assert_0_to_3(eval("((lambda () (define if list) (if 0 1 2 3)))"));
+		assert_0_to_3(eval("((lambda (quote) (quote 0 1 2 3)) list)"));
+		assert_0_to_3(eval("((lambda () (let ((and list)) (and 0 1 2 3))))"));
+	}
+	restore_engine();
+}
+END_TEST
+
+START_TEST(test_boolean_forms)
+{
+	unsigned i;
+	for_each_engine(i) {
+		assert_bool_true(eval("((lambda () (and)))"));
+		assert_num_eq(eval("((lambda () (and 1 2)))"), 2);
+		assert_bool_false(eval("((lambda () (and 1 #f 2)))"));
+		assert_bool_false(eval("((lambda () (or)))"));
+		assert_num_eq(eval("((lambda () (or #f 2)))"), 2);
+		assert_num_eq(eval("((lambda (x) (cond ((< x 0) 1) ((> x 0) 2) (else 3))) 5)"), 2);
+		assert_num_eq(eval("((lambda (x) (cond ((< x 0) 1) ((> x 0) 2) (else 3))) 0)"), 3);
+	}
+	restore_engine();
+}
+END_TEST
+
+START_TEST(test_frame_slots)
+{
+	unsigned i;
+	for_each_engine(i) {
+		assert_num_eq(eval("((lambda (x) (let* ((x (+ x 1)) (x (* x 2))) x)) 1)"), 4);
+		assert_num_eq(eval("((lambda (x) (define (get) x) (set! x 5) (get)) 1)"), 5);
+		assert_num_eq(eval("((lambda (a . b) (define c 3) (let ((d 4)) ((lambda () (set! a (+ a c d)) a)))) 1 2)"), 8);
+		assert_num_eq(eval("((lambda () (define-values (p q) (values 1 2)) (- q p)))"), 1);
+	}
+	restore_engine();
+}
+END_TEST
+
+static size_t call_bytes(navi_obj proc)
+{
+	size_t bytes = _navi_vm->heap.stats.nursery_bytes;
+	navi_force_tail(navi_apply(navi_procedure(proc), navi_make_nil(), env), env);
+	return _navi_vm->heap.stats.nursery_bytes - bytes;
+}
+
+/* builtins are passed their arguments on the stack */
+START_TEST(test_builtin_args)
+{
+	unsigned i;
+	eval("(define argv-pair (cons 1 2))");
+	for_each_engine(i) {
+		navi_obj f = eval("(lambda () (+ (car argv-pair) (- (cdr argv-pair) 1) 3))");
+		size_t guard = navi_gc_guard(f);
+		navi_obj g = eval("(lambda () 0)");
+		navi_gc_guard(g);
+		navi_gc_disable();
+		call_bytes(f);
+		call_bytes(g);
+		ck_assert_int_eq(call_bytes(f), call_bytes(g));
+		navi_gc_enable();
+		navi_gc_unguard(guard);
+	}
+	restore_engine();
+}
+END_TEST
+
+/* arity errors are reported before type errors */
+START_TEST(test_arg_checks)
+{
+	unsigned i;
+	eval("(define (check-args thunk)"
+		"(##call/ec (lambda (k)"
+			"(with-exception-handler"
+				"(lambda (e)"
+					"(if (string=? (cadr e) \"wrong number of arguments\")"
+						"(k 1)"
+						"(k 2)))"
+				"thunk))))");
+	for_each_engine(i) {
+		assert_num_eq(eval("(check-args (lambda () (car 1 2)))"), 1);
+		assert_num_eq(eval("(check-args (lambda () (apply car '(1 2))))"), 1);
+		assert_num_eq(eval("(check-args (lambda () (car 1)))"), 2);
+		assert_num_eq(eval("(check-args (lambda () (apply car '(1))))"), 2);
+		assert_num_eq(eval("(check-args (lambda () (vector-ref (vector 1) 'x)))"), 2);
+		assert_num_eq(eval("(vector-ref (vector 1 2) 1)"), 2);
+	}
+	restore_engine();
+}
+END_TEST
+
+/* cached global references see redefinitions, and calls don't invalidate them */
+START_TEST(test_global_cache)
+{
+	unsigned i;
+	for_each_engine(i) {
+		unsigned long version;
+		eval("(define gc-x 1)");
+		eval("(define (gc-get) (let ((y 0)) (+ y gc-x)))");
+		assert_num_eq(eval("(gc-get)"), 1);
+		eval("(set! gc-x 2)");
+		assert_num_eq(eval("(gc-get)"), 2);
+		navi_scope_unset(env.lexical, navi_make_symbol("gc-x"));
+		eval("(define gc-x 3)");
+		assert_num_eq(eval("(gc-get)"), 3);
+
+		version = _navi_vm->env_version;
+		assert_num_eq(eval("((lambda () (define (loop n) (if (= n 0) (gc-get) (loop (- n 1)))) (loop 100)))"), 3);
+		ck_assert_int_eq(_navi_vm->env_version, version);
+	}
+	restore_engine();
+}
+END_TEST
+
+/* the external apply forces tail calls instead of returning a bounce */
+START_TEST(test_extern_apply)
+{
+	unsigned i;
+	eval("(define (extern-id x) x)");
+	for_each_engine(i) {
+		navi_obj o = eval("(lambda (x) (extern-id x))");
+		size_t guard = navi_gc_guard(o);
+		o = navi_extern_apply(navi_procedure(o),
+				navi_make_pair(navi_make_fixnum(1),
+					navi_make_nil()), env);
+		assert_num_eq(o, 1);
+		navi_gc_unguard(guard);
+	}
+	restore_engine();
+}
+END_TEST
+
+/* escapes and errors which leave the VM for the top level reset its stacks */
+START_TEST(test_escape_unwind)
+{
+	navi_obj cont = navi_make_escape();
+	size_t guard = navi_gc_guard(cont);
+	navi_escape(cont)->roots = navi_gc_roots();
+	navi_scope_set(env.lexical, navi_make_symbol("unwind-k"), cont);
+	navi_scope_set(env.lexical, navi_sym_repl, cont);
+
+	navi_set_engine(NAVI_ENGINE_VM);
+	eval("(define (unwind-deep n thunk)"
+		"(if (= n 0) (thunk) (+ 1 (unwind-deep (- n 1) thunk))))");
+	if (!setjmp(navi_escape(cont)->state))
+		eval("(unwind-deep 100 (lambda () (unwind-k 0)))");
+	ck_assert_int_eq(_navi_vm->bytecode.sp, 0);
+	ck_assert_int_eq(_navi_vm->bytecode.fp, 0);
+	if (!setjmp(navi_escape(cont)->state))
+		eval("(unwind-deep 100 (lambda () (car 0)))");
+	ck_assert_int_eq(_navi_vm->bytecode.sp, 0);
+	ck_assert_int_eq(_navi_vm->bytecode.fp, 0);
+	assert_num_eq(eval("(unwind-deep 100 (lambda () 0))"), 100);
+
+	navi_scope_unset(env.lexical, navi_sym_repl);
+	navi_scope_unset(env.lexical, navi_make_symbol("unwind-k"));
+	navi_gc_unguard(guard);
+	restore_engine();
+}
+END_TEST
+
+TCase *compile_tests(void)
+{
+	TCase *tc = tcase_create("Compiler");
+	tcase_add_test(tc, test_tail_call);
+	tcase_add_test(tc, test_tail_forms);
+	tcase_add_test(tc, test_closures);
+	tcase_add_test(tc, test_shadowed_syntax);
+	tcase_add_test(tc, test_boolean_forms);
+	tcase_add_test(tc, test_frame_slots);
+	tcase_add_test(tc, test_builtin_args);
+	tcase_add_test(tc, test_arg_checks);
+	tcase_add_test(tc, test_global_cache);
+	tcase_add_test(tc, test_escape_unwind);
+	tcase_add_test(tc, test_extern_apply);
+	return tc;
+}
@@ -0,0 +1,515 @@
+/* Copyright 2014-2015 Drew Thoreson
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "test.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "../slab.h"
+
+/* old objects moved between old vectors while a major collection runs */
+START_TEST(test_incremental)
+{
+	unsigned long budget = navi_gc_set_budget(1);
+	eval("(define gc-a (make-vector 100 #f))");
+	eval("(define gc-b (make-vector 100 #f))");
+	eval("(define gc-c (make-vector 1000 #f))");
+	eval("((lambda ()"
+		"(define (fill i)"
+			"(if (< i 100)"
+				"(begin (vector-set! gc-b i (list 0 1 2 3))"
+				"       (fill (+ i 1)))))"
+		"(fill 0)))");
+	navi_gc_collect();
+	eval("((lambda ()"
+		"(define (move from to j)"
+			"(vector-set! to j (vector-ref from j))"
+			"(vector-set! from j #f))"
+		"(define (churn i)"
+			"(if (< i 200000)"
+				"(begin"
+					"(if (even? (quotient i 100))"
+					"    (move gc-b gc-a (remainder i 100))"
+					"    (move gc-a gc-b (remainder i 100)))"
+					"(vector-set! gc-c (remainder i 1000) (list i))"
+					"(churn (+ i 1)))))"
+		"(churn 0)))");
+	assert_0_to_3(eval("(vector-ref gc-b 0)"));
+	assert_bool_true(eval("((lambda ()"
+		"(define (check i)"
+			"(cond ((= i 100) #t)"
+			"      ((equal? (vector-ref gc-b i) '(0 1 2 3))"
+			"        (check (+ i 1)))"
+			"      (else #f)))"
+		"(check 0)))"));
+	navi_gc_set_budget(budget);
+}
+END_TEST
+
+/* a structure too deep to mark recursively */
+START_TEST(test_deep_mark)
+{
+	navi_obj nest = navi_make_nil();
+	for (int i = 0; i < 1000000; i++)
+		nest = navi_make_pair(nest, navi_make_nil());
+	size_t guard = navi_gc_guard(nest);
+	navi_gc_collect();
+	navi_gc_collect();
+	int depth = 0;
+	for (; navi_type(nest) == NAVI_PAIR; nest = navi_car(nest))
+		depth++;
+	ck_assert_int_eq(depth, 1000000);
+	ck_assert(navi_type(nest) == NAVI_NIL);
+	navi_gc_unguard(guard);
+}
+END_TEST
+
+/* guards are popped on return, and by escapes which skip the return */
+START_TEST(test_root_stack)
+{
+	size_t depth = navi_gc_roots();
+	size_t guard = navi_gc_guard(navi_make_pair(navi_make_nil(),
+				navi_make_nil()));
+	ck_assert_int_eq(guard, depth);
+	ck_assert_int_eq(navi_gc_roots(), depth + 1);
+	navi_gc_unguard(guard);
+	assert_num_eq(eval("(##call/ec (lambda (k)"
+				"(map (lambda (x) (if (= x 2) (k 2) x))"
+				"     (list 1 2 3))))"), 2);
+	ck_assert_int_eq(navi_gc_roots(), depth);
+	assert_num_eq(eval("(apply + (map (lambda (x) (* x x)) (list 1 2 3)))"),
+			14);
+	ck_assert_int_eq(navi_gc_roots(), depth);
+}
+END_TEST
+
+/* small strings keep their data inline until they outgrow it */
+START_TEST(test_string_storage)
+{
+	navi_obj obj = navi_cstr_to_string("abc");
+	struct navi_string *str = navi_string(obj);
+	ck_assert(navi_string_is_inline(str));
+	navi_string_grow_storage(str, 1000);
+	ck_assert(!navi_string_is_inline(str));
+	ck_assert(str->capacity >= 1003);
+	ck_assert_int_eq(str->size, 3);
+	ck_assert(!memcmp(str->data, "abc", 4));
+}
+END_TEST
+
+/* builtins are materialized once and keep their identity */
+START_TEST(test_builtin_identity)
+{
+	eval("(define gc-car ##car)");
+	navi_gc_collect();
+	navi_gc_collect();
+	assert_bool_true(eval("(eq? gc-car ##car)"));
+	assert_bool_true(eval("(eq? ##+ ##+)"));
+	assert_num_eq(eval("(gc-car '(1 2))"), 1);
+}
+END_TEST
+
+/* the symbol table grows, and interning finds every symbol again */
+START_TEST(test_symbol_table)
+{
+	char buf[32];
+	navi_obj *syms = malloc(50000 * sizeof(navi_obj));
+	for (int i = 0; i < 50000; i++) {
+		snprintf(buf, 32, "symtab-%d", i);
+		syms[i] = navi_gc_protect(navi_make_symbol(buf));
+	}
+	ck_assert(_navi_vm->heap.symbols.mask + 1 >= 50000);
+	for (int i = 0; i < 50000; i++) {
+		snprintf(buf, 32, "symtab-%d", i);
+		ck_assert(navi_make_symbol(buf).p == syms[i].p);
+		ck_assert_int_eq(navi_symbol(syms[i])->length, strlen(buf));
+		navi_gc_release(syms[i]);
+	}
+	free(syms);
+	ck_assert(navi_make_symbol_literal("symtab-7").p
+			== navi_make_symbol("symtab-7").p);
+	ck_assert(navi_make_uninterned("symtab-7").p
+			!= navi_make_symbol("symtab-7").p);
+}
+END_TEST
+
+/* unreferenced symbols are dropped from the table and freed */
+START_TEST(test_weak_symbols)
+{
+	char buf[32];
+	navi_obj kept = navi_gc_protect(navi_make_symbol("weak-kept"));
+	eval("(define weak-bound 'weak-bound-symbol)");
+	eval("(define weak-list (list 'weak-listed))");
+	navi_gc_collect();
+	size_t before = _navi_vm->heap.symbols.nr;
+	for (int i = 0; i < 20000; i++) {
+		snprintf(buf, 32, "weak-%d", i);
+		navi_make_symbol(buf);
+	}
+	ck_assert(_navi_vm->heap.symbols.nr >= before + 20000);
+	eval("((lambda ()"
+		"(define (loop i)"
+			"(if (< i 20000)"
+				"(begin (string->symbol (number->string i))"
+				"       (loop (+ i 1)))))"
+		"(loop 0)))");
+	navi_gc_collect();
+	navi_gc_collect();
+	ck_assert(_navi_vm->heap.symbols.nr <= before);
+	ck_assert(_navi_vm->heap.symbols.mask + 1 < 20000);
+	ck_assert(navi_make_symbol("weak-kept").p == kept.p);
+	assert_bool_true(eval("(eq? weak-bound (string->symbol \"weak-bound-symbol\"))"));
+	assert_bool_true(eval("(eq? (car weak-list) 'weak-listed)"));
+	assert_bool_true(eval("(equal? (symbol->string 'weak-x) \"weak-x\")"));
+	navi_gc_release(kept);
+}
+END_TEST
+
+/* empty slabs beyond the retention limit are given back */
+START_TEST(test_slab_shrink)
+{
+	struct slab_cache *cache = navi_slab_cache_create(64, 0, 0);
+	unsigned nr = cache->objs_per_slab * 10;
+	void **objs = malloc(nr * sizeof(void*));
+	for (unsigned i = 0; i < nr; i++)
+		objs[i] = navi_slab_alloc(cache);
+	for (unsigned i = 0; i < nr; i++)
+		navi_slab_free(cache, objs[i]);
+	navi_slab_flush();
+	unsigned nr_slabs = 0;
+	for (struct slab *slab = cache->slabs; slab; slab = slab->next)
+		nr_slabs++;
+	ck_assert(nr_slabs >= 10);
+	ck_assert_int_eq(cache->nr_empty, nr_slabs);
+	ck_assert_int_eq(navi_slab_shrink(cache, 2), nr_slabs - 2);
+	ck_assert_int_eq(cache->nr_empty, 2);
+	ck_assert_int_eq(navi_slab_shrink(cache, 2), 0);
+
+	// released slabs are reused
+	for (unsigned i = 0; i < nr; i++) {
+		objs[i] = navi_slab_alloc(cache);
+		memset(objs[i], 0xff, 64);
+	}
+	ck_assert_int_eq(cache->nr_empty, 0);
+	free(objs);
+}
+END_TEST
+
+#define NR_THREADS 4
+#define THREAD_OBJECTS 20000
+
+static struct slab_cache *thread_cache;
+static struct slab_cache *thread_swept_cache;
+
+static void *slab_thread(void *data)
+{
+	uintptr_t **objs = malloc(THREAD_OBJECTS * sizeof(uintptr_t*));
+	for (int round = 0; round < 10; round++) {
+		for (unsigned i = 0; i < THREAD_OBJECTS; i++) {
+			objs[i] = navi_slab_alloc(thread_cache);
+			*objs[i] = (uintptr_t) objs;
+		}
+		for (unsigned i = 0; i < THREAD_OBJECTS; i++) {
+			if (*objs[i] != (uintptr_t) objs)
+				return NULL;
+			navi_slab_free(thread_cache, objs[i]);
+		}
+	}
+	for (unsigned i = 0; i < THREAD_OBJECTS; i++)
+		navi_slab_alloc(thread_swept_cache);
+	free(objs);
+	navi_slab_flush();
+	return data;
+}
+
+static bool dead_always(void *mem)
+{
+	(void) mem;
+	return true;
+}
+
+/* threads allocate from shared caches through their own magazines */
+START_TEST(test_slab_threads)
+{
+	pthread_t threads[NR_THREADS];
+	thread_cache = navi_slab_cache_create(32, 0, 0);
+	thread_swept_cache = navi_slab_cache_create(32, NAVI_SLAB_SWEPT, 0);
+	for (long i = 0; i < NR_THREADS; i++)
+		pthread_create(&threads[i], NULL, slab_thread, (void*) (i + 1));
+	for (long i = 0; i < NR_THREADS; i++) {
+		void *result;
+		pthread_join(threads[i], &result);
+		ck_assert(result == (void*) (i + 1));
+	}
+
+	unsigned nr_slabs = 0;
+	for (struct slab *slab = thread_cache->slabs; slab; slab = slab->next) {
+		ck_assert_int_eq(slab->in_use, 0);
+		nr_slabs++;
+	}
+	ck_assert_int_eq(thread_cache->nr_empty, nr_slabs);
+
+	// every allocation from the swept cache is in the bitmaps
+	unsigned in_use = 0, used = 0;
+	nr_slabs = 0;
+	for (struct slab *slab = thread_swept_cache->slabs; slab;
+			slab = slab->next) {
+		in_use += slab->in_use;
+		for (unsigned w = 0; w < SLAB_MAP_WORDS; w++)
+			used += __builtin_popcountl(slab->used[w]);
+		nr_slabs++;
+	}
+	ck_assert_int_eq(in_use, NR_THREADS * THREAD_OBJECTS);
+	ck_assert_int_eq(used, NR_THREADS * THREAD_OBJECTS);
+	navi_slab_sweep_fresh(thread_swept_cache, dead_always);
+	ck_assert_int_eq(thread_swept_cache->nr_empty, nr_slabs);
+}
+END_TEST
+
+static navi_obj vm_eval(const char *str, navi_env vm_env)
+{
+	navi_obj port = navi_open_input_string(navi_cstr_to_string(str));
+	size_t guard = navi_gc_guard(port);
+	navi_obj result = navi_eval(navi_read(navi_port(port), vm_env), vm_env);
+	navi_gc_unguard(guard);
+	return result;
+}
+
+static void *vm_thread(void *data)
+{
+	char buf[64];
+	long id = (long) data;
+	struct navi_vm *vm = navi_vm_create();
+	navi_vm_enter(vm);
+	navi_env vm_env = navi_interaction_environment();
+	snprintf(buf, 64, "(define vm-id %ld)", id);
+	vm_eval(buf, vm_env);
+	vm_eval("(define (build n acc)"
+			"(if (= n 0) acc (build (- n 1) (cons n acc))))",
+			vm_env);
+	navi_obj result = vm_eval("((lambda ()"
+		"(define (loop i n)"
+			"(if (= i 20) n (loop (+ i 1) (length (build 50000 '())))))"
+		"(+ (loop 0 0) vm-id)))", vm_env);
+	navi_gc_collect();
+	long value = navi_fixnum(result);
+	navi_vm_leave();
+	navi_vm_destroy(vm);
+	return (void*) value;
+}
+
+/* independent VMs run in parallel, each on its own thread */
+START_TEST(test_vm_threads)
+{
+	pthread_t threads[NR_THREADS];
+	for (long i = 0; i < NR_THREADS; i++)
+		pthread_create(&threads[i], NULL, vm_thread, (void*) i);
+	for (long i = 0; i < NR_THREADS; i++) {
+		void *result;
+		pthread_join(threads[i], &result);
+		ck_assert_int_eq((long) result, 50000 + i);
+	}
+	// the current VM is unaffected
+	assert_num_eq(eval("(length (make-list 3 0))"), 3);
+}
+END_TEST
+
+#define CACHE_TEST_STRING "navi-cache-test-string"
+
+static void write_cache_test(const char *path, int value, time_t mtime)
+{
+	FILE *file = fopen(path, "w");
+	fprintf(file, "(define-library (cache-test)"
+			"(export cache-test-value cache-test-string)"
+			"(begin (##define cache-test-value %d)"
+			"       (##define cache-test-string \"%s\")))",
+			value, CACHE_TEST_STRING);
+	fclose(file);
+	struct timespec times[2] = { { mtime, 0 }, { mtime, 0 } };
+	utimensat(AT_FDCWD, path, times, 0);
+}
+
+/*
+ * Returns the offset of CACHE_TEST_STRING's data in the file at @path, or -1
+ * if it doesn't occur.
+ */
+static long find_test_string(const char *path)
+{
+	static char buf[1 << 20];
+	FILE *file = fopen(path, "r");
+	size_t size = fread(buf, 1, sizeof(buf), file);
+	fclose(file);
+	for (size_t i = 0; i + sizeof(CACHE_TEST_STRING) - 1 <= size; i++) {
+		if (!memcmp(buf + i, CACHE_TEST_STRING,
+					sizeof(CACHE_TEST_STRING) - 1))
+			return i;
+	}
+	return -1;
+}
+
+/* libraries restored from a heap image work without their source */
+START_TEST(test_image)
+{
+	char path[] = "/tmp/navi-image-XXXXXX";
+	int fd = mkstemp(path);
+	ck_assert(fd >= 0);
+	close(fd);
+	ck_assert(navi_save_image(path, env));
+
+	struct navi_vm *current = _navi_vm;
+	struct navi_vm *vm = navi_vm_create();
+	navi_vm_enter(vm);
+	navi_env vm_env = navi_empty_environment();
+	navi_scope_set(vm_env.dynamic, navi_sym_lib_paths, navi_make_nil());
+	ck_assert(navi_load_image(path, vm_env));
+	vm_eval("(import (scheme base) (scheme char))", vm_env);
+	navi_gc_collect();
+	assert_num_eq(vm_eval("(caar '((1 2) 3))", vm_env), 1);
+	navi_obj str = vm_eval("(string-map char-upcase \"abc\")", vm_env);
+	ck_assert(!strcmp((char*) navi_string(str)->data, "ABC"));
+	assert_bool_true(vm_eval("(eq? car ##car)", vm_env));
+	navi_vm_leave();
+	navi_vm_destroy(vm);
+	navi_vm_enter(current);
+
+	// a truncated image is rejected
+	ck_assert(!truncate(path, 200));
+	vm = navi_vm_create();
+	navi_vm_enter(vm);
+	vm_env = navi_empty_environment();
+	ck_assert(!navi_load_image(path, vm_env));
+	navi_vm_leave();
+	navi_vm_destroy(vm);
+	navi_vm_enter(current);
+	unlink(path);
+}
+END_TEST
+
+/* the layout of a heap image (see image.c) */
+#define IMAGE_HEADER_SIZE  32
+#define IMAGE_NR_LIBRARIES 24
+#define IMAGE_STRING       4
+
+/* an image claiming an oversized string is rejected before allocating */
+START_TEST(test_image_oversized)
+{
+	char path[] = "/tmp/navi-image-XXXXXX";
+	int fd = mkstemp(path);
+	ck_assert(fd >= 0);
+	close(fd);
+
+	// a VM with no libraries loaded saves a bare header
+	struct stat st;
+	struct navi_vm *current = _navi_vm;
+	struct navi_vm *vm = navi_vm_create();
+	navi_vm_enter(vm);
+	ck_assert(navi_save_image(path, navi_empty_environment()));
+	navi_vm_leave();
+	navi_vm_destroy(vm);
+	navi_vm_enter(current);
+	ck_assert(!stat(path, &st));
+	ck_assert_int_eq(st.st_size, IMAGE_HEADER_SIZE);
+
+	// one library, named by a string of 4 GiB with no data
+	uint32_t nr_libraries = 1, size = 0xFFFFFFF0, length = 0;
+	unsigned char name[9] = { IMAGE_STRING };
+	memcpy(name + 1, &size, sizeof(size));
+	memcpy(name + 5, &length, sizeof(length));
+	fd = open(path, O_WRONLY);
+	ck_assert(fd >= 0);
+	ck_assert(pwrite(fd, &nr_libraries, sizeof(nr_libraries),
+				IMAGE_NR_LIBRARIES) == sizeof(nr_libraries));
+	ck_assert(pwrite(fd, name, sizeof(name), IMAGE_HEADER_SIZE)
+			== sizeof(name));
+	close(fd);
+
+	vm = navi_vm_create();
+	navi_vm_enter(vm);
+	ck_assert(!navi_load_image(path, navi_empty_environment()));
+	navi_vm_leave();
+	navi_vm_destroy(vm);
+	navi_vm_enter(current);
+	unlink(path);
+}
+END_TEST
+
+static long import_cached(const char *dir)
+{
+	struct navi_vm *current = _navi_vm;
+	struct navi_vm *vm = navi_vm_create();
+	navi_vm_enter(vm);
+	navi_env vm_env = navi_empty_environment();
+	navi_scope_set(vm_env.dynamic, navi_sym_lib_paths,
+			navi_make_pair(navi_cstr_to_string(dir), navi_make_nil()));
+	vm_eval("(import (cache-test))", vm_env);
+	long value = navi_fixnum(vm_eval("cache-test-value", vm_env));
+	navi_vm_leave();
+	navi_vm_destroy(vm);
+	navi_vm_enter(current);
+	return value;
+}
+
+/* library definitions are read from the cache while their source is unchanged */
+START_TEST(test_library_cache)
+{
+	char dir[] = "/tmp/navi-cache-XXXXXX";
+	char src[64], cache[64], entry[512];
+	ck_assert(mkdtemp(dir));
+	snprintf(src, 64, "%s/cache-test.scm", dir);
+	snprintf(cache, 64, "%s/cache", dir);
+	setenv("NAVI_CACHE_DIR", cache, 1);
+
+	write_cache_test(src, 42, 1000000);
+	ck_assert_int_eq(import_cached(dir), 42);
+	// same size and modification time: the stale cache entry is used
+	write_cache_test(src, 43, 1000000);
+	ck_assert_int_eq(import_cached(dir), 42);
+	write_cache_test(src, 43, 2000000);
+	ck_assert_int_eq(import_cached(dir), 43);
+
+	// a corrupt cache entry is ignored, even while its key matches
+	DIR *d = opendir(cache);
+	struct dirent *ent;
+	ck_assert(d);
+	while ((ent = readdir(d)) && ent->d_name[0] == '.')
+		continue;
+	ck_assert(ent);
+	snprintf(entry, sizeof(entry), "%s/%s", cache, ent->d_name);
+	closedir(d);
+	write_cache_test(src, 44, 2000000);
+	long offset = find_test_string(entry);
+	ck_assert(offset >= 0);
+	ck_assert(!truncate(entry, offset + 4));
+	ck_assert_int_eq(import_cached(dir), 44);
+
+	setenv("NAVI_CACHE_DIR", "", 1);
+	unlink(entry);
+	unlink(src);
+	rmdir(cache);
+	rmdir(dir);
+}
+END_TEST
+
+TCase *heap_tests(void)
+{
+	TCase *tc = tcase_create("Heap");
+	tcase_add_test(tc, test_incremental);
+	tcase_add_test(tc, test_deep_mark);
+	tcase_add_test(tc, test_root_stack);
+	tcase_add_test(tc, test_string_storage);
+	tcase_add_test(tc, test_builtin_identity);
+	tcase_add_test(tc, test_symbol_table);
+	tcase_add_test(tc, test_weak_symbols);
+	tcase_add_test(tc, test_slab_shrink);
+	tcase_add_test(tc, test_slab_threads);
+	tcase_add_test(tc, test_vm_threads);
+	tcase_add_test(tc, test_image);
+	tcase_add_test(tc, test_image_oversized);
+	tcase_add_test(tc, test_library_cache);
+	return tc;
+}
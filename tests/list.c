@@ -45,6 +45,13 @@ END_TEST
 START_TEST(test_set_car)
 {
 	assert_num_eq(eval("(let ((p '(1 . 2))) (set-car! p 3) (car p))"), 3);
+	/* an old pair keeps a young car alive across a minor collection */
+	eval("(define old-pair (list #f))");
+	navi_gc_collect();
+	eval("(set-car! old-pair (list 0 1 2 3))");
+	eval("(make-list 20000)");
+	eval("(make-list 20000)");
+	assert_0_to_3(eval("(car old-pair)"));
 }
 END_TEST
 
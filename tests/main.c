@@ -12,8 +12,10 @@ Suite *arithmetic_suite(void);
 navi_obj eval(const char *str)
 {
 	navi_obj port = navi_open_input_string(navi_cstr_to_string(str));
+	size_t guard = navi_gc_guard(port);
 	navi_obj result = navi_eval(navi_read(navi_port(port), env), env);
 	navi_close_input_port(navi_port(port), env);
+	navi_gc_unguard(guard);
 	return result;
 }
 
@@ -23,7 +25,8 @@ int main(void)
 	Suite *s;
 	SRunner *sr;
 
-	/* initialize navi */
+	/* initialize navi; tests which use the library cache enable it */
+	setenv("NAVI_CACHE_DIR", "", 1);
 	navi_init();
 	env = navi_interaction_environment();
 
@@ -32,6 +35,8 @@ int main(void)
 	suite_add_tcase(s, arithmetic_tests());
 	suite_add_tcase(s, bytevector_tests());
 	suite_add_tcase(s, char_tests());
+	suite_add_tcase(s, compile_tests());
+	suite_add_tcase(s, heap_tests());
 	suite_add_tcase(s, lambda_tests());
 	suite_add_tcase(s, list_tests());
 	sr = srunner_create(s);
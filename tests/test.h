@@ -41,6 +41,8 @@ void assert_0_to_3(navi_obj list);
 
 TCase *arithmetic_tests(void);
 TCase *char_tests(void);
+TCase *compile_tests(void);
+TCase *heap_tests(void);
 TCase *bytevector_tests(void);
 TCase *lambda_tests(void);
 TCase *list_tests(void);
@@ -11,6 +11,7 @@ void navi_vector_fill(navi_obj vector, navi_obj fill)
 
 	for (size_t i = 0; i < vec->size; i++)
 		vec->data[i] = fill;
+	navi_gc_write_barrier(vector.p, fill);
 }
 
 navi_obj navi_list_to_vector(navi_obj list)
@@ -81,6 +82,7 @@ DEFUN(vector_set, "vector-set!", 3, 0, NAVI_VECTOR, NAVI_FIXNUM, NAVI_ANY)
 		navi_error(scm_env, "vector index out of bounds");
 
 	navi_vector(scm_arg1)->data[navi_fixnum(scm_arg2)] = scm_arg3;
+	navi_gc_write_barrier(scm_arg1.p, scm_arg3);
 	return navi_unspecified();
 }
 
@@ -98,8 +100,10 @@ static navi_obj copy_to(navi_obj to, size_t at, navi_obj from, size_t start,
 		size_t end)
 {
 	struct navi_vector *tov = navi_vector(to), *fromv = navi_vector(from);
-	for (size_t i = start; i < end; i++)
-		tov->data[at++] = fromv->data[i];
+	for (size_t i = start; i < end; i++) {
+		tov->data[at] = fromv->data[i];
+		navi_gc_write_barrier(to.p, tov->data[at++]);
+	}
 	return to;
 }
 
@@ -119,6 +123,7 @@ DEFUN(vector_fill, "vector-fill!", 2, NAVI_PROC_VARIADIC, NAVI_VECTOR, NAVI_ANY)
 
 	for (size_t i = start; i < (size_t) end; i++)
 		vec->data[i] = fill;
+	navi_gc_write_barrier(scm_arg1.p, fill);
 
 	return navi_unspecified();
 }
@@ -170,6 +175,7 @@ navi_obj navi_vector_map(navi_obj proc, navi_obj to, navi_obj from, navi_env env
 	for (size_t i = 0; i < tov->size; i++) {
 		navi_obj call = navi_list(proc, fromv->data[i], navi_make_void());
 		tov->data[i] = navi_eval(call, env);
+		navi_gc_write_barrier(to.p, tov->data[i]);
 	}
 	return to;
 }
@@ -197,15 +203,13 @@ static navi_obj do_apply(navi_obj proc, navi_obj args, navi_env env)
 	return navi_force_tail(navi_apply(navi_procedure(proc), args, env), env);
 }
 
-static size_t vector_array_fill(struct navi_vector *array[], navi_obj args,
-		navi_env env)
+static size_t vector_array_fill(struct navi_vector *array[], unsigned argc,
+		const navi_obj *argv, navi_env env)
 {
-	navi_obj cons;
-	size_t i = 0, min_len = navi_vector(navi_car(args))->size;
-	navi_list_for_each(cons, args) {
-		array[i] = navi_vector_cast(navi_car(cons), env);
+	size_t min_len = navi_vector(argv[0])->size;
+	for (unsigned i = 0; i < argc; i++) {
+		array[i] = navi_vector_cast(argv[i], env);
 		min_len = array[i]->size < min_len ? array[i]->size : min_len;
-		i++;
 	}
 	return min_len;
 }
@@ -217,7 +221,7 @@ DEFUN(vector_for_each, "vector-for-each", 2, NAVI_PROC_VARIADIC,
 	struct navi_vector *args[scm_nr_args-1];
 
 	navi_check_arity(scm_arg1, scm_nr_args-1, scm_env);
-	min_len = vector_array_fill(args, navi_cdr(scm_args), scm_env);
+	min_len = vector_array_fill(args, scm_nr_args-1, scm_argv+1, scm_env);
 
 	for (size_t i = 0; i < min_len; i++)
 		do_apply(scm_arg1, arg_list(args, scm_nr_args-1, i), scm_env);
@@ -230,17 +234,21 @@ DEFUN(vector_map, "vector-map", 2, NAVI_PROC_VARIADIC,
 	size_t min_len;
 	navi_obj result;
 	struct navi_vector *vec;
+	size_t guard;
 	struct navi_vector *args[scm_nr_args-1];
 
 	navi_check_arity(scm_arg1, scm_nr_args-1, scm_env);
-	min_len = vector_array_fill(args, navi_cdr(scm_args), scm_env);
+	min_len = vector_array_fill(args, scm_nr_args-1, scm_argv+1, scm_env);
 
 	result = navi_make_vector(min_len);
 	vec = navi_vector(result);
+	guard = navi_gc_guard(result);
 
 	for (size_t i = 0; i < min_len; i++) {
 		vec->data[i] = do_apply(scm_arg1,
 				arg_list(args, scm_nr_args-1, i), scm_env);
+		navi_gc_write_barrier(result.p, vec->data[i]);
 	}
+	navi_gc_unguard(guard);
 	return result;
 }
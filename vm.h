@@ -0,0 +1,86 @@
+/* Copyright 2014-2015 Drew Thoreson
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef _NAVI_VM_H_
+#define _NAVI_VM_H_
+
+/*
+ * Bytecode for the virtual machine in vm.c.  Bytecode is generated by
+ * compile.c from the closure tree of a procedure body, so it inherits the
+ * compiler's analysis: special forms are already resolved and local variables
+ * already have frame addresses.
+ *
+ * The VM is a stack machine.  Every expression leaves one value on the stack,
+ * except where noted below.  Frames are the same environment frames used by
+ * the closure compiler.
+ */
+enum vm_opcode {
+	VM_CONST,       /* push consts[b] */
+	VM_VOID,        /* push the unspecified value */
+	VM_REF,         /* push the value of the variable refs[b], from a
+	                   function with @a frames */
+	VM_LOCAL0,      /* push slot b of the current frame */
+	VM_LOCAL,       /* push slot b of the frame @a levels up */
+	VM_STORE_LOCAL, /* pop into slot b of the frame @a levels up */
+	VM_DEFINE,      /* pop and bind consts[b] in the current frame */
+	VM_SET,         /* pop and assign to the variable named consts[b] */
+	VM_POP,         /* pop and discard */
+	VM_JUMP,        /* jump to b */
+	VM_JUMP_FALSE,  /* pop, and jump to b if the value is #f */
+	VM_JUMP_TRUE,   /* pop, and jump to b if the value is not #f */
+	VM_LAMBDA,      /* push a procedure created from lambdas[b] */
+	VM_FRAME,       /* pop @a values into a new frame described by lets[b] */
+	VM_UNFRAME,     /* return to the parent of the current frame */
+	VM_CALL,        /* call with @a arguments; consts[b] is the form */
+	VM_TAIL_CALL,   /* as above, in tail position */
+	VM_RETURN,      /* pop and return */
+	VM_EVAL,        /* push the value of consts[b] (via the tree-walker) */
+	VM_TAIL_EVAL,   /* as above, in tail position */
+	VM_NR_OPCODES
+};
+
+struct vm_insn {
+	unsigned op : 8;
+	unsigned a : 24;
+	unsigned b;
+};
+
+struct vm_lambda {
+	navi_obj args;
+	navi_obj body;
+	navi_obj name;
+	bool anonymous;
+	struct navi_code *code;
+};
+
+/* a variable looked up by name */
+struct vm_ref {
+	navi_obj symbol;
+	struct navi_ref_cache cache;
+};
+
+struct vm_let {
+	unsigned nr_slots;
+	navi_obj *names;
+};
+
+struct vm_function {
+	unsigned nr_insns;
+	unsigned nr_consts;
+	unsigned nr_refs;
+	unsigned nr_lambdas;
+	unsigned nr_lets;
+	/* the maximum number of values pushed by a call to this function */
+	unsigned max_stack;
+	struct vm_insn *insns;
+	navi_obj *consts;
+	struct vm_ref *refs;
+	struct vm_lambda *lambdas;
+	struct vm_let *lets;
+};
+
+#endif